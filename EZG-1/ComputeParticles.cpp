@@ -0,0 +1,658 @@
+#include "ComputeParticles.h"
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <random>
+
+// Bytes per update in the counter readback ring, the counters followed by the draw count
+static const GLsizeiptr COUNTER_READBACK_STRIDE = sizeof(ParticleCounters) + sizeof(GLuint);
+
+// Buffer bindings, same as in the particle compute shaders
+enum ParticleBinding {
+	PARTICLE_BINDING = 0,
+	DEAD_LIST_BINDING = 1,
+	ALIVE_LIST_BINDING = 2,
+	NEXT_ALIVE_LIST_BINDING = 3,
+	COUNTER_BINDING = 4,
+	REQUEST_BINDING = 5,
+	INDIRECT_BINDING = 6,
+	SORT_KEY_BINDING = 7,
+	SORT_INDEX_BINDING = 8,
+	VISIBLE_LIST_BINDING = 12,
+	SPAWN_COMMAND_BINDING = 13
+};
+
+// Clip space half size of the billboards, 0.2 * size in particleRenderGS.glsl.
+// Also covers PARTICLE_BILLBOARD_SIZE at the 60 degree field of view of the scene
+static const float BILLBOARD_SIZE = 0.6f;
+
+// Emitter keys of the spawn commands start here, below are the slots of emitting particles
+static const GLuint SPAWN_COMMAND_EMITTER = 0x80000000u;
+// Spawn commands with this bit set take their positions from the emission surface
+static const GLuint SURFACE_EMITTER = 0x40000000u;
+
+ComputeParticleSystem::ComputeParticleSystem(unsigned int capacity) : mCapacity(capacity)
+{
+	glGenBuffers(1, &mParticleBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mParticleBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(PackedParticle) * capacity, nullptr, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &mDeadListBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mDeadListBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * capacity, nullptr, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(2, mAliveListBuffers);
+	for (int i = 0; i < 2; i++)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mAliveListBuffers[i]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * capacity, nullptr, GL_DYNAMIC_DRAW);
+	}
+
+	glGenBuffers(1, &mCounterBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCounterBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(ParticleCounters), nullptr, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &mRequestBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mRequestBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(SpawnCommand) * MAX_EMIT_REQUESTS, nullptr, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &mIndirectBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mIndirectBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(ParticleIndirectArgs), nullptr, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &mVisibleBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mVisibleBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * capacity, nullptr, GL_DYNAMIC_COPY);
+
+	glGenBuffers(1, &mSpawnRingBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSpawnRingBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(SpawnCommand) * MAX_SPAWN_COMMANDS * SPAWN_RING_FRAMES, nullptr, GL_STREAM_DRAW);
+
+	// a ParticleCounters followed by the draw count per update
+	glGenBuffers(1, &mCounterReadbackBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mCounterReadbackBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, COUNTER_READBACK_STRIDE * COUNTER_READBACK_FRAMES, nullptr, GL_STREAM_READ);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glGenBuffers(1, &mSortKeyBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSortKeyBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * capacity, nullptr, GL_DYNAMIC_COPY);
+
+	glGenBuffers(1, &mSortIndexBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSortIndexBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * capacity, nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// particles are pulled from the storage buffers, the VAO stays empty
+	glGenVertexArrays(1, &mVAO);
+
+	LoadShaders();
+	mSort = new GpuRadixSort(capacity);
+	mGrid = new GpuSpatialHash(capacity);
+	mTrails = new ParticleTrails();
+}
+
+ComputeParticleSystem::~ComputeParticleSystem()
+{
+	glDeleteBuffers(1, &mParticleBuffer);
+	glDeleteBuffers(1, &mDeadListBuffer);
+	glDeleteBuffers(2, mAliveListBuffers);
+	glDeleteBuffers(1, &mCounterBuffer);
+	glDeleteBuffers(1, &mRequestBuffer);
+	glDeleteBuffers(1, &mIndirectBuffer);
+	glDeleteBuffers(1, &mVisibleBuffer);
+	glDeleteBuffers(1, &mSpawnRingBuffer);
+	for (GLsync fence : mSpawnFences)
+		if (fence != nullptr)
+			glDeleteSync(fence);
+	glDeleteBuffers(1, &mCounterReadbackBuffer);
+	for (GLsync fence : mCounterFences)
+		if (fence != nullptr)
+			glDeleteSync(fence);
+	glDeleteBuffers(1, &mSortKeyBuffer);
+	glDeleteBuffers(1, &mSortIndexBuffer);
+	glDeleteVertexArrays(1, &mVAO);
+	delete mSimulateShader;
+	delete mEmitShader;
+	delete mArgsShader;
+	delete mRenderShader;
+	delete mBillboardShader;
+	delete mSortKeysShader;
+	delete mSort;
+	delete mGrid;
+	delete mTrails;
+}
+
+void ComputeParticleSystem::LoadShaders()
+{
+	delete mSimulateShader;
+	delete mEmitShader;
+	delete mArgsShader;
+	delete mRenderShader;
+	delete mBillboardShader;
+	delete mSortKeysShader;
+
+	mSimulateShader = new Shader("Shaders/particleSimulateCS.glsl");
+	mEmitShader = new Shader("Shaders/particleEmitCS.glsl");
+	mArgsShader = new Shader("Shaders/particleArgsCS.glsl");
+	mRenderShader = new Shader("Shaders/particlePullVS.glsl", "Shaders/particleRenderPS.glsl", "Shaders/particleRenderGS.glsl");
+	mBillboardShader = new Shader("Shaders/particleBillboardVS.glsl", "Shaders/particleRenderPS.glsl");
+	mSortKeysShader = new Shader("Shaders/particleSortKeysCS.glsl");
+	if (mSort != nullptr)
+		mSort->LoadShaders();
+	if (mGrid != nullptr)
+		mGrid->LoadShaders();
+	if (mTrails != nullptr)
+		mTrails->LoadShaders();
+}
+
+void ComputeParticleSystem::Reset(const particlestruct* particles, unsigned int count)
+{
+	count = count < mCapacity ? count : mCapacity;
+
+	mOrigin = mNextOrigin;
+	std::vector<PackedParticle> initial(count);
+	std::vector<GLuint> alive(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		initial[i] = PackParticle(particles[i], mOrigin);
+		alive[i] = i;
+	}
+
+	// every slot after the initial particles is free, the top of the stack is at the end
+	std::vector<GLuint> dead(mCapacity - count);
+	for (unsigned int i = 0; i < dead.size(); i++)
+		dead[i] = mCapacity - 1 - i;
+
+	ParticleCounters counters = { GLint(dead.size()), count, 0, 0, 0, 0, 0 };
+	ParticleIndirectArgs args = { { (count + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE, 1, 1 }, { 0, 1, 1 }, count, 1, 0, 0, 4, count, 0, 0 };
+	mCurrentAlive = 0;
+	mFrame = 0;
+	mTime = 0.0f;
+	mSpawnQueue.clear();
+	mSpawnCommands = 0;
+	mTrails->Clear();
+	// the copies in flight are from before the reset, the counters of the reset are known
+	for (GLsync& fence : mCounterFences)
+	{
+		if (fence != nullptr)
+			glDeleteSync(fence);
+		fence = nullptr;
+	}
+	mCounters = counters;
+	mDrawCount = count;
+	mCountedFrame = 0;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mParticleBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(PackedParticle) * count, initial.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mDeadListBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint) * dead.size(), dead.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mAliveListBuffers[mCurrentAlive]);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint) * count, alive.data());
+	// nothing is culled until the first update
+	mDrawVisible = false;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCounterBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(ParticleCounters), &counters);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mIndirectBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(ParticleIndirectArgs), &args);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void ComputeParticleSystem::PollCounters()
+{
+	// newest first, the copies of the last updates are most likely still in flight
+	for (int n = 1; n <= (int)COUNTER_READBACK_FRAMES && mFrame - n >= mCountedFrame; n++)
+	{
+		unsigned int slot = (mFrame - n) % COUNTER_READBACK_FRAMES;
+		GLsync& fence = mCounterFences[slot];
+		if (fence == nullptr || mCounterFrames[slot] != mFrame - n)
+			continue;
+		GLint status = GL_UNSIGNALED;
+		glGetSynciv(fence, GL_SYNC_STATUS, sizeof(status), nullptr, &status);
+		if (status != GL_SIGNALED)
+			continue;
+
+		// the copy is done, so reading it back does not wait
+		glBindBuffer(GL_COPY_READ_BUFFER, mCounterReadbackBuffer);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, COUNTER_READBACK_STRIDE * slot, sizeof(ParticleCounters), &mCounters);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, COUNTER_READBACK_STRIDE * slot + sizeof(ParticleCounters), sizeof(GLuint), &mDrawCount);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glDeleteSync(fence);
+		fence = nullptr;
+		mCountedFrame = mFrame - n + 1;
+		return;
+	}
+}
+
+void ComputeParticleSystem::SetCamera(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model, float viewportHeight)
+{
+	mCullMatrix = projection * view * model;
+	mViewportHeight = viewportHeight;
+	// whole units, so a camera at rest does not requantize the particles every update
+	mNextOrigin = glm::floor(glm::vec3(glm::inverse(view * model)[3]));
+}
+
+void ComputeParticleSystem::setCullingUniforms(Shader* shader)
+{
+	shader->setBool("culling", Culling);
+	shader->setMat4("cullMatrix", mCullMatrix);
+	shader->setFloat("billboardSize", BILLBOARD_SIZE);
+	shader->setFloat("minPixelSize", MinPixelSize);
+	shader->setFloat("viewportHeight", mViewportHeight);
+}
+
+void ComputeParticleSystem::bindBuffers()
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLE_BINDING, mParticleBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DEAD_LIST_BINDING, mDeadListBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ALIVE_LIST_BINDING, mAliveListBuffers[mCurrentAlive]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, NEXT_ALIVE_LIST_BINDING, mAliveListBuffers[1 - mCurrentAlive]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COUNTER_BINDING, mCounterBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, REQUEST_BINDING, mRequestBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INDIRECT_BINDING, mIndirectBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_LIST_BINDING, mVisibleBuffer);
+}
+
+void ComputeParticleSystem::Spawn(glm::vec3 position, unsigned int count, float type, float speed, float lifeTime)
+{
+	mSpawnQueue.push_back({ position, type, count, SPAWN_COMMAND_EMITTER | (mSpawnCommands++ & ~(SPAWN_COMMAND_EMITTER | SURFACE_EMITTER)), speed, lifeTime });
+}
+
+void ComputeParticleSystem::SpawnOnSurface(unsigned int count, float type, float speed, float lifeTime)
+{
+	if (Surface == nullptr || Surface->TriangleCount() == 0)
+		return;
+	mSpawnQueue.push_back({ glm::vec3(0.0f), type, count, SPAWN_COMMAND_EMITTER | SURFACE_EMITTER | (mSpawnCommands++ & ~(SPAWN_COMMAND_EMITTER | SURFACE_EMITTER)), speed, lifeTime });
+}
+
+unsigned int ComputeParticleSystem::uploadSpawnCommands()
+{
+	unsigned int count = std::min((unsigned int)mSpawnQueue.size(), MAX_SPAWN_COMMANDS);
+	if (count == 0)
+		return 0;
+
+	// the region was last read SPAWN_RING_FRAMES updates ago, the driver may still have that frame queued.
+	// Once its fence signaled the map does not need to sync, usually the wait is over before it starts
+	unsigned int region = mFrame % SPAWN_RING_FRAMES;
+	if (mSpawnFences[region] != nullptr)
+	{
+		// the flush makes sure the fence gets to the GPU, otherwise the wait could last forever
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while (glClientWaitSync(mSpawnFences[region], flags, 1000000) == GL_TIMEOUT_EXPIRED)
+			flags = 0;
+		glDeleteSync(mSpawnFences[region]);
+		mSpawnFences[region] = nullptr;
+	}
+	GLintptr offset = sizeof(SpawnCommand) * MAX_SPAWN_COMMANDS * region;
+	GLsizeiptr size = sizeof(SpawnCommand) * count;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSpawnRingBuffer);
+	void* commands = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (commands == nullptr)
+	{
+		std::cout << "ERROR::PARTICLES::SPAWN_RING_NOT_MAPPED" << std::endl;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		return 0;
+	}
+	memcpy(commands, mSpawnQueue.data(), size);
+	glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SPAWN_COMMAND_BINDING, mSpawnRingBuffer, offset, size);
+
+	mSpawnQueue.erase(mSpawnQueue.begin(), mSpawnQueue.begin() + count);
+	return count;
+}
+
+void ComputeParticleSystem::Update(float deltaTime, bool spawnNewEmitter, glm::vec3 spawnPosition)
+{
+	bindBuffers();
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, mIndirectBuffer);
+
+	// the simulate pass counts the emitters without a trail anew every update
+	GLuint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCounterBuffer);
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, offsetof(ParticleCounters, traillessCount), sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// sort the alive particles into the grid for the neighbour queries of the simulation
+	if (Interaction.Enabled)
+		mGrid->Build(mCounterBuffer, offsetof(ParticleIndirectArgs, simulateGroups), Interaction.CellSize, mOrigin);
+
+	// 1. simulate the alive particles, survivors go to the next alive list, the rest back to the dead list
+	mSimulateShader->use();
+	mSimulateShader->setFloat("deltaTime", deltaTime);
+	mSimulateShader->setBool("spawnNewEmitter", spawnNewEmitter);
+	mSimulateShader->setVec3("spawnPosition", spawnPosition);
+	mSimulateShader->setVec3("unpackOrigin", mOrigin);
+	mSimulateShader->setVec3("packOrigin", mNextOrigin);
+	mSimulateShader->setInt("frame", mFrame);
+	mSimulateShader->setBool("interaction", Interaction.Enabled);
+	setCullingUniforms(mSimulateShader);
+	if (Interaction.Enabled)
+	{
+		mGrid->Bind();
+		mSimulateShader->setFloat("cellSize", Interaction.CellSize);
+		mSimulateShader->setInt("tableMask", mGrid->TableMask());
+		mSimulateShader->setFloat("repulsionRadius", Interaction.RepulsionRadius);
+		mSimulateShader->setFloat("repulsionStrength", Interaction.RepulsionStrength);
+		mSimulateShader->setInt("maxNeighbours", Interaction.MaxNeighbours);
+		mSimulateShader->setFloat("restitution", Interaction.Restitution);
+		mSimulateShader->setBool("terrainCollision", TerrainTexture != 0);
+		mSimulateShader->setVec3("terrainDimensions", TerrainDimensions);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_3D, TerrainTexture);
+	}
+	bool turbulence = Turbulence.Enabled && TurbulenceField != nullptr;
+	float emitterDrift = Trails.Enabled && TurbulenceField != nullptr ? Trails.EmitterDrift : 0.0f;
+	mSimulateShader->setBool("turbulence", turbulence);
+	mSimulateShader->setFloat("emitterDrift", emitterDrift);
+	if (turbulence || emitterDrift > 0.0f)
+	{
+		mSimulateShader->setFloat("turbulenceStrength", Turbulence.Strength);
+		mSimulateShader->setFloat("turbulenceTileSize", Turbulence.TileSize);
+		mSimulateShader->setVec3("turbulenceOffset", Turbulence.Scroll * mTime);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_3D, TurbulenceField->Texture());
+		glActiveTexture(GL_TEXTURE0);
+	}
+	// emitters that died while the trails were off still hold theirs
+	if (Trails.Enabled && !mTrailsRecorded)
+		mTrails->Clear();
+	mTrailsRecorded = Trails.Enabled;
+	mSimulateShader->setBool("trails", Trails.Enabled);
+	mSimulateShader->setInt("trailCount", mTrails->TrailCount());
+	mSimulateShader->setInt("trailLength", mTrails->Length());
+	mSimulateShader->setFloat("trailInterval", Trails.SampleInterval);
+	mTrails->Bind();
+	glDispatchComputeIndirect(offsetof(ParticleIndirectArgs, simulateGroups));
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// 2. size the emit dispatch from the number of emit requests and spawn commands
+	unsigned int commandCount = uploadSpawnCommands();
+	mArgsShader->use();
+	mArgsShader->setInt("stage", 0);
+	mArgsShader->setInt("commandCount", commandCount);
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+	// 3. turn the emit requests into particles taken from the dead list
+	mEmitShader->use();
+	mEmitShader->setInt("frame", mFrame);
+	mEmitShader->setVec3("packOrigin", mNextOrigin);
+	mEmitShader->setInt("commandCount", commandCount);
+	mEmitShader->setInt("surfaceTriangleCount", Surface != nullptr ? Surface->TriangleCount() : 0);
+	if (Surface != nullptr)
+		Surface->Bind();
+	setCullingUniforms(mEmitShader);
+	glDispatchComputeIndirect(offsetof(ParticleIndirectArgs, emitGroups));
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	// the spawn commands of this update are read once the emit pass is done
+	if (commandCount > 0)
+		mSpawnFences[mFrame % SPAWN_RING_FRAMES] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	// 4. the next alive list becomes the current one, write the simulate dispatch and draw arguments for it
+	mArgsShader->use();
+	mArgsShader->setInt("stage", 1);
+	mArgsShader->setBool("culling", Culling);
+	mDrawVisible = Culling;
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+
+	// 5. copy the counters and the draw count for PollCounters, read once the fence behind the copy signaled
+	unsigned int slot = mFrame % COUNTER_READBACK_FRAMES;
+	if (mCounterFences[slot] != nullptr)
+		glDeleteSync(mCounterFences[slot]);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mCounterReadbackBuffer);
+	glBindBuffer(GL_COPY_READ_BUFFER, mCounterBuffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, COUNTER_READBACK_STRIDE * slot, sizeof(ParticleCounters));
+	glBindBuffer(GL_COPY_READ_BUFFER, mIndirectBuffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offsetof(ParticleIndirectArgs, drawCount),
+		COUNTER_READBACK_STRIDE * slot + sizeof(ParticleCounters), sizeof(GLuint));
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	mCounterFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	mCounterFrames[slot] = mFrame;
+
+	mCurrentAlive = 1 - mCurrentAlive;
+	mOrigin = mNextOrigin;
+	mFrame++;
+	mTime += deltaTime;
+}
+
+void ComputeParticleSystem::bindDrawList()
+{
+	bindBuffers();
+	if (mDrawVisible)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ALIVE_LIST_BINDING, mVisibleBuffer);
+}
+
+void ComputeParticleSystem::Render(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model)
+{
+	// the draw list takes the place of the alive list for sorting and drawing
+	bindDrawList();
+	if (SortBackToFront)
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SORT_KEY_BINDING, mSortKeyBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SORT_INDEX_BINDING, mSortIndexBuffer);
+		mSortKeysShader->use();
+		mSortKeysShader->setMat4("modelView", view * model);
+		mSortKeysShader->setInt("capacity", mCapacity);
+		mSortKeysShader->setVec3("origin", mOrigin);
+		glDispatchCompute((mCapacity + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		mSort->Sort(mSortKeyBuffer, mSortIndexBuffer, mCapacity);
+
+		// the sorted slots replace the draw list
+		bindBuffers();
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ALIVE_LIST_BINDING, mSortIndexBuffer);
+	}
+
+	// the ribbons are written by the simulate pass, so they are only current after an update
+	if (Trails.Enabled && mTrailsRecorded)
+		mTrails->Render(projection, view, model, Trails.Width, Blending);
+
+	Shader* shader = Billboards ? mBillboardShader : mRenderShader;
+	shader->use();
+	shader->setMat4("projection", projection);
+	shader->setMat4("view", view);
+	shader->setMat4("model", model);
+	shader->setVec3("origin", mOrigin);
+	shader->setInt("blendMode", Blending);
+	shader->setFloat("opacity", PARTICLE_OPACITY);
+
+	glBindVertexArray(mVAO);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mIndirectBuffer);
+	if (Billboards)
+	{
+		shader->setBool("drawListed", true);
+		shader->setBool("packedParticles", true);
+		shader->setFloat("particleSize", PARTICLE_BILLBOARD_SIZE);
+		glDrawArraysIndirect(GL_TRIANGLE_STRIP, (void*)offsetof(ParticleIndirectArgs, quadVertexCount));
+	}
+	else
+	{
+		glDrawArraysIndirect(GL_POINTS, (void*)offsetof(ParticleIndirectArgs, drawCount));
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+void ComputeParticleSystem::BenchmarkRender(const std::vector<unsigned int>& counts, unsigned int repetitions)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> distribution(-10.0f, 10.0f);
+
+	// every particle in front of the camera, so neither path gets to clip anything away
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 300.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 40.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	GLuint query;
+	glGenQueries(1, &query);
+
+	std::cout << "Particle render benchmark, " << repetitions << " repetitions" << std::endl;
+	for (unsigned int count : counts)
+	{
+		std::vector<particlestruct> particles(count);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			particles[i].position = glm::vec3(distribution(random), distribution(random), distribution(random));
+			particles[i].velocity = glm::vec3(0.0f);
+			particles[i].lifeTime = 0.0f;
+			particles[i].type = TYPE_A;
+		}
+
+		ComputeParticleSystem system(count);
+		system.Reset(particles.data(), count);
+		for (bool billboards : { false, true })
+		{
+			system.Billboards = billboards;
+			GLuint64 totalNanoseconds = 0;
+			for (unsigned int repetition = 0; repetition < repetitions; repetition++)
+			{
+				glBeginQuery(GL_TIME_ELAPSED, query);
+				system.Render(projection, view, glm::mat4(1.0f));
+				glEndQuery(GL_TIME_ELAPSED);
+
+				GLuint64 nanoseconds = 0;
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+				totalNanoseconds += nanoseconds;
+			}
+			std::cout << count << " particles, " << (billboards ? "instanced billboards: " : "geometry shader: ")
+				<< double(totalNanoseconds) / 1000000.0 / repetitions << " ms/frame" << std::endl;
+		}
+	}
+
+	glDeleteQueries(1, &query);
+}
+
+void ComputeParticleSystem::BenchmarkTransparency(const std::vector<unsigned int>& counts, const std::vector<float>& spreads, unsigned int repetitions,
+	ParticleTransparency& transparency)
+{
+	std::mt19937 random(1234);
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 300.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 40.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	GLuint queries[2];
+	glGenQueries(2, queries);
+
+	std::cout << "Particle transparency benchmark, " << repetitions << " repetitions" << std::endl;
+	for (float spread : spreads)
+	{
+		std::uniform_real_distribution<float> distribution(-spread * 0.5f, spread * 0.5f);
+		for (unsigned int count : counts)
+		{
+			std::vector<particlestruct> particles(count);
+			for (unsigned int i = 0; i < count; i++)
+			{
+				particles[i].position = glm::vec3(distribution(random), distribution(random), distribution(random));
+				particles[i].velocity = glm::vec3(0.0f);
+				particles[i].lifeTime = 0.0f;
+				particles[i].type = TYPE_A;
+			}
+
+			ComputeParticleSystem system(count);
+			system.Reset(particles.data(), count);
+			system.Billboards = true;
+			system.Culling = false;
+
+			// fragments per pixel of one draw, the same for both modes
+			GLuint64 samples = 0;
+			for (ParticleBlendMode mode : { PARTICLE_BLEND_ALPHA, PARTICLE_BLEND_WEIGHTED })
+			{
+				system.Blending = mode;
+				system.SortBackToFront = mode == PARTICLE_BLEND_ALPHA;
+				GLuint64 totalNanoseconds = 0;
+				for (unsigned int repetition = 0; repetition < repetitions; repetition++)
+				{
+					glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+					glBeginQuery(GL_TIME_ELAPSED, queries[0]);
+					if (repetition == 0 && mode == PARTICLE_BLEND_ALPHA)
+						glBeginQuery(GL_SAMPLES_PASSED, queries[1]);
+					transparency.Begin(mode);
+					system.Render(projection, view, glm::mat4(1.0f));
+					if (repetition == 0 && mode == PARTICLE_BLEND_ALPHA)
+						glEndQuery(GL_SAMPLES_PASSED);
+					transparency.End(mode);
+					glEndQuery(GL_TIME_ELAPSED);
+
+					GLuint64 nanoseconds = 0;
+					glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &nanoseconds);
+					totalNanoseconds += nanoseconds;
+					if (repetition == 0 && mode == PARTICLE_BLEND_ALPHA)
+						glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &samples);
+				}
+				std::cout << count << " particles in " << spread << " units, overdraw " << double(samples) / (double(viewport[2]) * viewport[3])
+					<< ", " << particleBlendModeNames[mode] << (mode == PARTICLE_BLEND_ALPHA ? " sorted: " : ": ")
+					<< double(totalNanoseconds) / 1000000.0 / repetitions << " ms/frame" << std::endl;
+			}
+		}
+	}
+
+	glDeleteQueries(2, queries);
+}
+
+void ComputeParticleSystem::BenchmarkSoftParticles(const std::vector<unsigned int>& counts, unsigned int repetitions, ParticleTransparency& transparency)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> distribution(-10.0f, 10.0f);
+	// the planes the depth linearization of the soft mode expects
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, transparency.NearPlane, transparency.FarPlane);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 25.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	int divisor = transparency.Divisor;
+
+	GLuint query;
+	glGenQueries(1, &query);
+
+	std::cout << "Soft particle benchmark, " << repetitions << " repetitions" << std::endl;
+	for (unsigned int count : counts)
+	{
+		std::vector<particlestruct> particles(count);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			particles[i].position = glm::vec3(distribution(random), distribution(random), distribution(random));
+			particles[i].velocity = glm::vec3(0.0f);
+			particles[i].lifeTime = 0.0f;
+			particles[i].type = TYPE_A;
+		}
+
+		ComputeParticleSystem system(count);
+		system.Reset(particles.data(), count);
+		system.Billboards = true;
+		system.Culling = false;
+		system.Blending = PARTICLE_BLEND_SOFT;
+		system.SortBackToFront = true;
+
+		for (int resolutionDivisor : { 1, 2, 4 })
+		{
+			transparency.Divisor = resolutionDivisor;
+			GLuint64 totalNanoseconds = 0;
+			for (unsigned int repetition = 0; repetition < repetitions; repetition++)
+			{
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				// includes the depth downsample and the upsample, the overhead the lower fill cost has to pay for
+				glBeginQuery(GL_TIME_ELAPSED, query);
+				transparency.Begin(PARTICLE_BLEND_SOFT);
+				system.Render(projection, view, glm::mat4(1.0f));
+				transparency.End(PARTICLE_BLEND_SOFT);
+				glEndQuery(GL_TIME_ELAPSED);
+
+				GLuint64 nanoseconds = 0;
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+				totalNanoseconds += nanoseconds;
+			}
+			std::cout << count << " particles, 1/" << resolutionDivisor << " resolution: "
+				<< double(totalNanoseconds) / 1000000.0 / repetitions << " ms/frame" << std::endl;
+		}
+	}
+
+	transparency.Divisor = divisor;
+	glDeleteQueries(1, &query);
+}
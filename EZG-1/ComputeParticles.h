@@ -0,0 +1,201 @@
+#pragma once
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+#include "Shader.h"
+#include "EmissionSurface.h"
+#include "ForceField.h"
+#include "Particles.h"
+#include "PackedParticle.h"
+#include "ParticleTransparency.h"
+#include "ParticleTrails.h"
+#include "GpuRadixSort.h"
+#include "GpuSpatialHash.h"
+
+#include <vector>
+
+// Atomic counters shared by the compute passes
+struct ParticleCounters
+{
+	GLint deadCount;
+	GLuint aliveCount;
+	GLuint nextAliveCount;
+	GLuint requestCount;
+	// particles dropped since the last reset because the dead list or the request buffer was full
+	GLuint overflowCount;
+	// entries of the visible list written by the current update
+	GLuint visibleCount;
+	// emitters of the last update that found no free trail in their probe window, see ParticleTrails
+	GLuint traillessCount;
+};
+
+// Indirect arguments written by particleArgsCS, the CPU only reads the draw count back, a few updates late
+struct ParticleIndirectArgs
+{
+	GLuint simulateGroups[3];
+	GLuint emitGroups[3];
+	GLuint drawCount;
+	GLuint drawInstanceCount;
+	GLuint drawFirst;
+	GLuint drawBaseInstance;
+	// instanced billboard draw of the same particles, 4 vertices per instance
+	GLuint quadVertexCount;
+	GLuint quadInstanceCount;
+	GLuint quadFirst;
+	GLuint quadBaseInstance;
+};
+
+// Burst of particles queued by the CPU, same layout as the emit requests of particleSimulateCS.glsl
+struct SpawnCommand
+{
+	glm::vec3 position;
+	float type;
+	GLuint count;
+	// keys the spawn velocities, set by Spawn
+	GLuint emitter;
+	// TYPE_A: scale of the random spawn velocity and the lifetime the particles start at
+	float speed;
+	float lifeTime;
+};
+
+// Compute shader version of the transform feedback particle system. Particles stay in fixed slots,
+// free slots are kept in a dead list and live ones in an alive list that is rebuilt every update.
+// Emitters append emit requests, which a separate dispatch turns into new particles from the dead list.
+// Particles are stored as 16 byte PackedParticle, relative to an origin that follows the camera.
+class ComputeParticleSystem
+{
+public:
+	static const unsigned int WORK_GROUP_SIZE = 256;
+	static const unsigned int MAX_EMIT_REQUESTS = 4096;
+	// Spawn commands uploaded per update, the rest stay queued for the next one
+	static const unsigned int MAX_SPAWN_COMMANDS = 4096;
+	// Updates the spawn ring holds, a region is only written again once the fence behind its emit pass signaled
+	static const unsigned int SPAWN_RING_FRAMES = 3;
+	// Updates the counter readback ring holds, the counters are read at most that many updates late
+	static const unsigned int COUNTER_READBACK_FRAMES = 4;
+
+	ComputeParticleSystem(unsigned int capacity);
+	~ComputeParticleSystem();
+
+	// (Re)loads the compute and render shaders, called on shader hot reloading
+	void LoadShaders();
+	void Reset(const particlestruct* particles, unsigned int count);
+
+	// Camera the update culls against, model takes the particles to world space.
+	// The next update also repacks the particles relative to the camera position.
+	void SetCamera(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model, float viewportHeight);
+	// Queues a burst of count particles of the given type for the next update. Every queued burst is uploaded
+	// into the spawn ring at once and emitted by the same dispatch as the requests of the simulation.
+	void Spawn(glm::vec3 position, unsigned int count, float type, float speed = 1.0f, float lifeTime = 0.0f);
+	// Queues a burst whose particles are spread uniformly over Surface, nothing is spawned while it is unset or empty
+	void SpawnOnSurface(unsigned int count, float type, float speed = 1.0f, float lifeTime = 0.0f);
+	unsigned int QueuedSpawns() const { return (unsigned int)mSpawnQueue.size(); }
+	void Update(float deltaTime, bool spawnNewEmitter, glm::vec3 spawnPosition);
+	void Render(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model);
+
+	unsigned int Capacity() const { return mCapacity; }
+	// Draws instanced view space billboards pulled from the particle buffer instead of expanding points
+	// in the geometry shader
+	bool Billboards = true;
+	// Sorts the alive particles back to front before drawing. Sorts the whole capacity, the alive count stays on the GPU
+	bool SortBackToFront = false;
+	// Blending of the particle sprites, the caller sets up the blend state with ParticleTransparency
+	ParticleBlendMode Blending = PARTICLE_BLEND_OPAQUE;
+
+	// The update writes the particles inside the frustum and at least MinPixelSize high on screen into
+	// a visible list that is drawn instead of the alive list, so culled particles are never drawn
+	bool Culling = true;
+	float MinPixelSize = 1.0f;
+
+	// Repulsion and terrain collision of the TYPE_A particles through a grid built every update
+	ParticleInteraction Interaction;
+	// Density volume the particles collide with, 0 disables terrain collision
+	GLuint TerrainTexture = 0;
+	glm::vec3 TerrainDimensions = glm::vec3(0.0f);
+	// Curl noise acceleration of the TYPE_A particles, one texture fetch per particle while a field is set
+	ParticleForceField Turbulence;
+	const ForceField* TurbulenceField = nullptr;
+	// Ribbons behind the emitters, recorded by the simulate pass. Emitters drift along TurbulenceField while on.
+	ParticleTrailSettings Trails;
+	const ParticleTrails& TrailBuffers() const { return *mTrails; }
+	// Surface SpawnOnSurface spreads its particles over, in the space of the particles
+	const EmissionSurface* Surface = nullptr;
+	// Every update copies its counters and draw count into a readback ring behind a fence. PollCounters reads
+	// the newest copy the GPU has finished, so like TransformFeedbackCounter it never waits and lags a few updates.
+	void PollCounters();
+	const ParticleCounters& Counters() const { return mCounters; }
+	// Particles drawn by the update the counters are from
+	GLuint DrawCount() const { return mDrawCount; }
+	// Updates since the one the counters are from
+	unsigned int CounterLatency() const { return mFrame - mCountedFrame; }
+
+	// Prints GPU render times of the geometry shader and the billboard path for the given particle counts, waits for the GPU
+	static void BenchmarkRender(const std::vector<unsigned int>& counts, unsigned int repetitions);
+	// Prints GPU times of back to front sorted alpha blending and of weighted blended OIT for the given particle
+	// counts, spread over cubes of the given sizes around the view center. Smaller cubes raise the overdraw,
+	// which is measured with an occlusion query. Draws into the default framebuffer and waits for the GPU.
+	static void BenchmarkTransparency(const std::vector<unsigned int>& counts, const std::vector<float>& spreads, unsigned int repetitions,
+		ParticleTransparency& transparency);
+	// Prints GPU times of the soft particles at the resolution divisors 1, 2 and 4 for the given particle counts,
+	// spread over a cube in front of the view so they cover most of the screen. Waits for the GPU.
+	static void BenchmarkSoftParticles(const std::vector<unsigned int>& counts, unsigned int repetitions, ParticleTransparency& transparency);
+
+private:
+	unsigned int mCapacity;
+
+	GLuint mParticleBuffer;
+	GLuint mDeadListBuffer;
+	GLuint mAliveListBuffers[2];
+	GLuint mCounterBuffer;
+	GLuint mRequestBuffer;
+	GLuint mIndirectBuffer;
+	GLuint mVisibleBuffer;
+	GLuint mSortKeyBuffer;
+	GLuint mSortIndexBuffer;
+	GLuint mSpawnRingBuffer;
+	// behind the emit pass that read each spawn ring region, null while the region is free
+	GLsync mSpawnFences[SPAWN_RING_FRAMES] = {};
+	// counters and draw count of the last updates, one region per update, fenced behind the copy
+	GLuint mCounterReadbackBuffer;
+	GLsync mCounterFences[COUNTER_READBACK_FRAMES] = {};
+	int mCounterFrames[COUNTER_READBACK_FRAMES] = {};
+	ParticleCounters mCounters = {};
+	GLuint mDrawCount = 0;
+	// mFrame after the update the counters are from
+	int mCountedFrame = 0;
+	GLuint mVAO;
+	// alive list that holds the particles of the last update
+	int mCurrentAlive = 0;
+	// updates since the last reset, keys the spawn velocities
+	int mFrame = 0;
+	// seconds simulated since the last reset, scrolls the force field
+	float mTime = 0.0f;
+	std::vector<SpawnCommand> mSpawnQueue;
+	// spawn commands queued since the last reset, keys their spawn velocities
+	unsigned int mSpawnCommands = 0;
+	// origin the stored particles are packed relative to, and the one the next update packs them to
+	glm::vec3 mOrigin = glm::vec3(0.0f);
+	glm::vec3 mNextOrigin = glm::vec3(0.0f);
+	glm::mat4 mCullMatrix = glm::mat4(1.0f);
+	float mViewportHeight = 1.0f;
+	// the draw arguments of the last update count the visible list
+	bool mDrawVisible = false;
+
+	Shader* mSimulateShader = nullptr;
+	Shader* mEmitShader = nullptr;
+	Shader* mArgsShader = nullptr;
+	Shader* mRenderShader = nullptr;
+	Shader* mBillboardShader = nullptr;
+	Shader* mSortKeysShader = nullptr;
+	GpuRadixSort* mSort = nullptr;
+	GpuSpatialHash* mGrid = nullptr;
+	ParticleTrails* mTrails = nullptr;
+	// trails were recorded by the last update, emitters do not release theirs while they are off
+	bool mTrailsRecorded = false;
+
+	void bindBuffers();
+	// Copies up to MAX_SPAWN_COMMANDS queued commands into the next ring region and binds it, returns the count
+	unsigned int uploadSpawnCommands();
+	void bindDrawList();
+	void setCullingUniforms(Shader* shader);
+};
@@ -0,0 +1,299 @@
+#include "DensityJournal.h"
+
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+// Journal file layout: header, compacted bricks, then the raw ops appended since the last compaction
+struct JournalHeader
+{
+	char magic[4];
+	unsigned int brickCount;
+};
+
+static const char JOURNAL_MAGIC[4] = { 'D', 'J', '0', '1' };
+
+DensityJournal::DensityJournal(glm::ivec3 dimensions, unsigned int compactThreshold, const std::string& filePrefix)
+	: mDimensions(dimensions), mCompactThreshold(compactThreshold), mFilePrefix(filePrefix)
+{
+	mBrickCount = (dimensions + glm::ivec3(BRICK_SIZE - 1)) / BRICK_SIZE;
+}
+
+DensityJournal::~DensityJournal()
+{
+	if (mBrickBuffer != 0)
+		glDeleteBuffers(1, &mBrickBuffer);
+}
+
+std::string DensityJournal::fileName(int sector) const
+{
+	return mFilePrefix + std::to_string(sector) + ".journal";
+}
+
+SectorEdits& DensityJournal::load(int sector)
+{
+	auto it = mSectors.find(sector);
+	if (it != mSectors.end())
+		return it->second;
+
+	SectorEdits& edits = mSectors[sector];
+	std::ifstream file(fileName(sector), std::ios::binary);
+	if (!file)
+		return edits;
+
+	// a sector has at most one brick per block, anything else is a truncated or corrupt journal
+	unsigned int maxBricks = (unsigned int)(mBrickCount.x * mBrickCount.y * mBrickCount.z);
+	JournalHeader header;
+	bool valid = file.read(reinterpret_cast<char*>(&header), sizeof(header)) && memcmp(header.magic, JOURNAL_MAGIC, 4) == 0
+		&& header.brickCount <= maxBricks;
+	if (valid)
+	{
+		edits.bricks.resize(header.brickCount);
+		valid = bool(file.read(reinterpret_cast<char*>(edits.bricks.data()), sizeof(DensityBrick) * header.brickCount));
+	}
+	for (unsigned int i = 0; valid && i < edits.bricks.size(); i++)
+	{
+		glm::ivec3 origin = glm::ivec3(edits.bricks[i].origin);
+		glm::ivec3 brickCoord = origin / BRICK_SIZE;
+		valid = glm::all(glm::greaterThanEqual(origin, glm::ivec3(0))) && origin == brickCoord * BRICK_SIZE
+			&& glm::all(glm::lessThan(brickCoord, mBrickCount));
+		if (valid)
+			edits.brickLookup[(brickCoord.z * mBrickCount.y + brickCoord.y) * mBrickCount.x + brickCoord.x] = i;
+	}
+	if (!valid)
+	{
+		std::cout << "ERROR::DENSITY_JOURNAL::INVALID_FILE " << fileName(sector) << std::endl;
+		edits.bricks.clear();
+		edits.brickLookup.clear();
+		return edits;
+	}
+
+	BrushOp op;
+	while (file.read(reinterpret_cast<char*>(&op), sizeof(op)))
+		edits.ops.push_back(op);
+
+	return edits;
+}
+
+bool DensityJournal::save(int sector, const SectorEdits& edits)
+{
+	// write to a temporary file first, so a crash never leaves a half written journal behind
+	std::string name = fileName(sector);
+	std::string tempName = name + ".tmp";
+	{
+		std::ofstream file(tempName, std::ios::binary | std::ios::trunc);
+		JournalHeader header;
+		memcpy(header.magic, JOURNAL_MAGIC, 4);
+		header.brickCount = (unsigned int)edits.bricks.size();
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(edits.bricks.data()), sizeof(DensityBrick) * edits.bricks.size());
+		file.write(reinterpret_cast<const char*>(edits.ops.data()), sizeof(BrushOp) * edits.ops.size());
+		file.flush();
+		if (!file)
+		{
+			std::cout << "ERROR::DENSITY_JOURNAL::WRITE_FAILED " << tempName << std::endl;
+			return false;
+		}
+	}
+	// replaces the old journal in one step, it is never missing in between
+#ifdef _WIN32
+	bool replaced = MoveFileExA(tempName.c_str(), name.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	bool replaced = std::rename(tempName.c_str(), name.c_str()) == 0;
+#endif
+	if (!replaced)
+		std::cout << "ERROR::DENSITY_JOURNAL::REPLACE_FAILED " << name << std::endl;
+	return replaced;
+}
+
+DensityBrick& DensityJournal::brick(SectorEdits& edits, glm::ivec3 brickCoord)
+{
+	int key = (brickCoord.z * mBrickCount.y + brickCoord.y) * mBrickCount.x + brickCoord.x;
+	auto it = edits.brickLookup.find(key);
+	if (it != edits.brickLookup.end())
+		return edits.bricks[it->second];
+
+	edits.brickLookup[key] = (unsigned int)edits.bricks.size();
+	edits.bricks.emplace_back();
+	DensityBrick& newBrick = edits.bricks.back();
+	newBrick.origin = glm::ivec4(brickCoord * BRICK_SIZE, 0);
+	std::fill(newBrick.delta, newBrick.delta + BRICK_VOXELS, 0.0f);
+	return newBrick;
+}
+
+void DensityJournal::rasterize(SectorEdits& edits)
+{
+	for (unsigned int i = edits.rasterizedOps; i < edits.ops.size(); i++)
+	{
+		const BrushOp& op = edits.ops[i];
+		glm::ivec3 minVoxel = glm::clamp(glm::ivec3(glm::floor(op.center - op.radius)), glm::ivec3(0), mDimensions - 1);
+		glm::ivec3 maxVoxel = glm::clamp(glm::ivec3(glm::ceil(op.center + op.radius)), glm::ivec3(0), mDimensions - 1);
+		float edge = std::min(op.hardness, 0.999f);
+
+		for (int z = minVoxel.z; z <= maxVoxel.z; z++)
+		{
+			for (int y = minVoxel.y; y <= maxVoxel.y; y++)
+			{
+				for (int x = minVoxel.x; x <= maxVoxel.x; x++)
+				{
+					float distance = glm::length(glm::vec3(x, y, z) - op.center) / op.radius;
+					if (distance >= 1.0f)
+						continue;
+
+					DensityBrick& target = brick(edits, glm::ivec3(x, y, z) / BRICK_SIZE);
+					glm::ivec3 inner = glm::ivec3(x, y, z) - glm::ivec3(target.origin);
+					target.delta[(inner.z * BRICK_SIZE + inner.y) * BRICK_SIZE + inner.x] += op.strength * (1.0f - glm::smoothstep(edge, 1.0f, distance));
+				}
+			}
+		}
+	}
+	edits.rasterizedOps = (unsigned int)edits.ops.size();
+}
+
+void DensityJournal::AppendBrush(const WorldPosition& center, float radius, float strength, float hardness)
+{
+	float sectorLength = float(mDimensions.z - 1);
+	for (int offset = -1; offset <= 1; offset++)
+	{
+		BrushOp op;
+		op.center = center.Local - glm::vec3(0.0f, 0.0f, float(offset) * sectorLength);
+		op.radius = radius;
+		op.strength = strength;
+		op.hardness = hardness;
+		if (op.center.z + radius >= 0.0f && op.center.z - radius <= float(mDimensions.z - 1))
+			Append(center.Sector + offset, op);
+	}
+}
+
+void DensityJournal::Append(int sector, const BrushOp& op)
+{
+	SectorEdits& edits = load(sector);
+	edits.ops.push_back(op);
+
+	// append the op to the end of the journal, a new journal starts with an empty header
+	std::string name = fileName(sector);
+	bool exists = std::ifstream(name, std::ios::binary).good();
+	std::ofstream file(name, std::ios::binary | std::ios::app);
+	if (!exists)
+	{
+		JournalHeader header;
+		memcpy(header.magic, JOURNAL_MAGIC, 4);
+		header.brickCount = 0;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	}
+	file.write(reinterpret_cast<const char*>(&op), sizeof(op));
+	file.close();
+
+	if (edits.ops.size() >= mCompactThreshold)
+		Compact(sector);
+}
+
+void DensityJournal::Compact(int sector)
+{
+	SectorEdits& edits = load(sector);
+	rasterize(edits);
+	// the ops are only dropped once the bricks are on disk, until then the journal still has them as ops
+	std::vector<BrushOp> ops;
+	ops.swap(edits.ops);
+	if (save(sector, edits))
+	{
+		edits.rasterizedOps = 0;
+		return;
+	}
+	ops.swap(edits.ops);
+}
+
+void DensityJournal::Retain(int lowerSector, int upperSector)
+{
+	for (auto it = mSectors.begin(); it != mSectors.end();)
+	{
+		if (it->first >= lowerSector && it->first <= upperSector)
+		{
+			++it;
+			continue;
+		}
+
+		// compact before dropping, so the next load only has to read bricks
+		if (!it->second.ops.empty())
+			Compact(it->first);
+		it = mSectors.erase(it);
+	}
+}
+
+bool DensityJournal::HasEdits(int sector)
+{
+	SectorEdits& edits = load(sector);
+	return !edits.bricks.empty() || !edits.ops.empty();
+}
+
+unsigned int DensityJournal::BrickCount(int sector)
+{
+	SectorEdits& edits = load(sector);
+	rasterize(edits);
+	return (unsigned int)edits.bricks.size();
+}
+
+void DensityJournal::Apply(int sector, float* density)
+{
+	SectorEdits& edits = load(sector);
+	rasterize(edits);
+
+	for (const DensityBrick& b : edits.bricks)
+	{
+		int width = std::min(BRICK_SIZE, mDimensions.x - b.origin.x);
+		int height = std::min(BRICK_SIZE, mDimensions.y - b.origin.y);
+		int depth = std::min(BRICK_SIZE, mDimensions.z - b.origin.z);
+
+		for (int z = 0; z < depth; z++)
+		{
+			for (int y = 0; y < height; y++)
+			{
+				float* row = density + ((size_t(b.origin.z + z) * mDimensions.y + (b.origin.y + y)) * mDimensions.x + b.origin.x);
+				const float* delta = b.delta + (z * BRICK_SIZE + y) * BRICK_SIZE;
+#ifdef __AVX__
+				// a brick row is exactly one 8 wide float vector
+				if (width == BRICK_SIZE)
+				{
+					_mm256_storeu_ps(row, _mm256_add_ps(_mm256_loadu_ps(row), _mm256_loadu_ps(delta)));
+					continue;
+				}
+#endif
+				for (int x = 0; x < width; x++)
+					row[x] += delta[x];
+			}
+		}
+	}
+}
+
+void DensityJournal::Apply(int sector, GLuint densityTexture, Shader& editShader)
+{
+	SectorEdits& edits = load(sector);
+	rasterize(edits);
+	if (edits.bricks.empty())
+		return;
+
+	if (mBrickBuffer == 0)
+		glGenBuffers(1, &mBrickBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mBrickBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(DensityBrick) * edits.bricks.size(), edits.bricks.data(), GL_STREAM_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mBrickBuffer);
+
+	// one work group per brick, one invocation per voxel
+	editShader.use();
+	glBindImageTexture(0, densityTexture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R16F);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	glDispatchCompute((GLuint)edits.bricks.size(), 1, 1);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+}
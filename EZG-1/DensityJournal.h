@@ -0,0 +1,83 @@
+#pragma once
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+#include "Shader.h"
+#include "FloatingOrigin.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Edge length of a delta brick in voxels
+const int BRICK_SIZE = 8;
+const int BRICK_VOXELS = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
+// A single brush stroke, in sector local voxel coordinates
+struct BrushOp
+{
+	glm::vec3 center;
+	float radius;
+	// density added at the center of the brush, negative values carve
+	float strength;
+	// 0 gives a soft falloff over the whole radius, 1 a hard edge
+	float hardness;
+};
+
+// Density difference of one 8x8x8 block of a sector
+struct DensityBrick
+{
+	glm::ivec4 origin; // voxel coordinates of the first voxel, w unused
+	float delta[BRICK_VOXELS];
+};
+
+// Edits of one sector: compacted bricks plus the ops appended since the last compaction
+struct SectorEdits
+{
+	std::vector<DensityBrick> bricks;
+	std::unordered_map<int, unsigned int> brickLookup;
+	std::vector<BrushOp> ops;
+	// ops already rasterized into the bricks in memory, but still stored as ops on disk
+	unsigned int rasterizedOps = 0;
+};
+
+// Append only journal of density edits. Every brush op is written to the journal file of its sector
+// right away, so edits survive eviction and restarts. Once enough ops have piled up they are compacted
+// into sparse brick deltas, which are added onto freshly generated density when a sector is loaded.
+class DensityJournal
+{
+public:
+	DensityJournal(glm::ivec3 dimensions, unsigned int compactThreshold = 64, const std::string& filePrefix = "sector_");
+	~DensityJournal();
+
+	// Records a brush stroke, strokes reaching over a sector border are recorded in both sectors
+	void AppendBrush(const WorldPosition& center, float radius, float strength, float hardness);
+	void Append(int sector, const BrushOp& op);
+	// Rasterizes pending ops into bricks and rewrites the journal file without them
+	void Compact(int sector);
+	// Drops all sectors outside of [lowerSector, upperSector] from memory, their journals stay on disk
+	void Retain(int lowerSector, int upperSector);
+
+	bool HasEdits(int sector);
+	unsigned int BrickCount(int sector);
+
+	// Adds the edits of a sector onto a density volume laid out x fastest, then y, then z
+	void Apply(int sector, float* density);
+	// Adds the edits of a sector onto a GL_R16F density texture using densityEditCS
+	void Apply(int sector, GLuint densityTexture, Shader& editShader);
+
+private:
+	glm::ivec3 mDimensions;
+	glm::ivec3 mBrickCount;
+	unsigned int mCompactThreshold;
+	std::string mFilePrefix;
+	std::unordered_map<int, SectorEdits> mSectors;
+	GLuint mBrickBuffer = 0;
+
+	std::string fileName(int sector) const;
+	SectorEdits& load(int sector);
+	// Rewrites the journal of a sector with its bricks and ops, false if the old journal is still in place
+	bool save(int sector, const SectorEdits& edits);
+	void rasterize(SectorEdits& edits);
+	DensityBrick& brick(SectorEdits& edits, glm::ivec3 brickCoord);
+};
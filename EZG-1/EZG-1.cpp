@@ -10,6 +10,21 @@
 
 #include "Shader.h"
 #include "Camera.h"
+#include "FloatingOrigin.h"
+#include "DensityJournal.h"
+#include "Particles.h"
+#include "ParticleSimulator.h"
+#include "ParticlePool.h"
+#include "ComputeParticles.h"
+#include "EmissionSurface.h"
+#include "GpuTimer.h"
+#include "TransformFeedbackCounter.h"
+#include "ParticleBufferRing.h"
+#include "GpuRadixSort.h"
+#include "ParticleRecording.h"
+#include "ParticleTransparency.h"
+#include "VarianceShadowMap.h"
+#include "ShadowCascades.h"
 
 #include "interpolation.h"
 #include "Timer.h"
@@ -30,6 +45,16 @@ enum Game_Mode {
 	RIDE
 };
 
+enum Particle_Mode {
+	TRANSFORM_FEEDBACK,
+	CPU_SIMULATION,
+	CPU_POOL,
+	COMPUTE_SHADER,
+	PARTICLE_MODE_COUNT
+};
+
+const char* particleModeNames[] = { "transform feedback", "CPU simulation", "CPU pool", "compute shader" };
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
@@ -38,34 +63,61 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 unsigned int loadTexture(const char* path);
 void renderScene(const Shader& shader);
+void renderStaticCasters(const Shader& shader);
+void renderDynamicCasters(const Shader& shader);
 void renderCube();
 void renderQuad();
 void renderWalls();
 void SetupParticles();
-
-const unsigned int MAX_PARTICLES = 100000;
-const unsigned int EMITTER_COUNT = 10;
+void UpdateParticles();
+void RenderParticles(const glm::mat4& projection, const glm::mat4& view);
 
 Shader* particleRenderShader;
+Shader* particleBillboardShader;
 Shader* particleTransformShader;
-unsigned int particleVBO[2];
-unsigned int particleTFB[2];
-//unsigned int particleVAO;
-unsigned int randomTexture;
+// particle buffers of the transform feedback and CPU particles, fenced so they are not written while drawn
+const unsigned int PARTICLE_BUFFER_DEPTH = 3;
+ParticleBufferRing* particleBuffers;
+bool sortParticles = false;
+// instanced billboards instead of the geometry shader for the CPU and compute shader particles
+bool billboardParticles = true;
+// blending of the particle sprites, weighted blended OIT draws into its own targets and composites over the scene
+ParticleBlendMode particleBlending = PARTICLE_BLEND_OPAQUE;
+ParticleTransparency* particleTransparency = nullptr;
+// transform feedback updates since startup, keys the spawn velocities in particleTransformGS.glsl
+int particleFrame = 0;
+
+// CPU particle simulation, uploaded into the particle buffers instead of running transform feedback
+Particle_Mode particleMode = TRANSFORM_FEEDBACK;
+ParticleSimulator* particleSimulator;
+// CPU particles in fixed slots of a free list pool
+ParticlePool* particlePool;
+std::vector<particlestruct> particleUpload;
+unsigned int particleUploadCount = 0;
+
+// Compute shader particles with dead/alive lists and indirect draw
+ComputeParticleSystem* computeParticles = nullptr;
+// Curl noise volume that stirs the TYPE_A particles of the CPU pool and compute shader particles
+ForceField* particleForceField = nullptr;
+// Triangles J spreads particle bursts over, only rebuilt when the mesh it comes from changes
+EmissionSurface* particleSurface = nullptr;
+
+// GPU times of the particle passes, averaged per particle mode for comparison
+GpuTimer* particleUpdateTimer;
+GpuTimer* particleRenderTimer;
+// live count and overflow of the transform feedback particles, read back a few frames late
+TransformFeedbackCounter* particleFeedbackCounter;
+double particleModeUpdateTimes[PARTICLE_MODE_COUNT] = {};
+double particleModeRenderTimes[PARTICLE_MODE_COUNT] = {};
+float lastParticleReport = 0.0f;
+
+// Record or replay of the particle input, set from the command line
+ParticleRecorder* particleRecorder = nullptr;
+ParticleReplay* particleReplay = nullptr;
 
 bool spawnParticles = false;
 glm::vec3 spawnParticlePosition = glm::vec3(0.f, 0.f, 0.f);
 
-int currVB = 0;
-int currTFB = 1;
-
-struct particlestruct
-{
-	glm::vec3 position;
-	glm::vec3 velocity;
-	float lifeTime;
-	float type;
-};
 
 // settings
 const unsigned int SCR_WIDTH = 1920;
@@ -73,6 +125,11 @@ const unsigned int SCR_HEIGHT = 1080;
 
 // camera
 Camera camera(glm::vec3(0.0f, 1.0f, 0.0f));
+// the projection of the camera, the shadow cascades are fit to the same frustum
+const float CAMERA_FOV = glm::radians(60.0f);
+const float CAMERA_ASPECT = (float)SCR_WIDTH / (float)SCR_HEIGHT;
+const float CAMERA_NEAR = 0.1f;
+const float CAMERA_FAR = 300.0f;
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
@@ -95,7 +152,7 @@ bool visualize = false;
 
 Game_Mode gameMode = CREATE;
 
-std::vector<glm::vec3> waypoints;
+std::vector<WorldPosition> waypoints;
 std::vector<glm::quat> orientations;
 
 // Textures
@@ -133,6 +190,7 @@ Shader* basicShader;
 Shader *marchingCubesShader;
 Shader *densityComputeShader;
 Shader* displacementShader;
+Shader* densityEditShader;
 GLuint densityTextureA;
 GLuint densityTextureB;
 GLuint noiseTexture;
@@ -150,6 +208,11 @@ float pointScale = 1;
 GLuint mcTableTexture;
 GLuint mcTableBuffer;
 
+// Terrain editing, brush strokes are journaled per sector and added onto the generated density
+DensityJournal* densityJournal;
+float brushRadius = 6.0f;
+float brushStrength = 1.0f;
+
 int cameraSector = 0;
 int previousCameraSector = 0;
 int reloadUpperSectorBound = 150;
@@ -157,19 +220,33 @@ int reloadLowerSectorBound = -150;
 int cameraSectorHeight = 255;
 bool reload = false;
 
+// Floating origin, moves along with the camera so positions uploaded to shaders stay small
+FloatingOrigin floatingOrigin(cameraSectorHeight, reloadLowerSectorBound, reloadUpperSectorBound);
+
 GLenum err;
 
 // meshes
 unsigned int planeVAO;
+// texture of the test scene
+unsigned int woodTexture;
 
 // Variance Shadow Mapping
 Shader* storeDepthShader;
 Shader* VSMShader;
 Shader* simpleDepthShader;
 Shader* debugShader;
-unsigned int depthMap;
-unsigned int depthMapFBO;
-const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
+// blurred and mipmapped moments of the light's depth, one layer per cascade
+VarianceShadowMap* varianceShadowMap = nullptr;
+// shadow cascades fitted to the camera frustum every frame
+ShadowCascades shadowCascades(4);
+// the dynamic shadow caster of the test scene, the rest of it is cached in the shadow map
+bool moveShadowCaster = false;
+// angle of the dynamic caster, set once per frame so the shadow and lighting passes see it in the same place.
+// It stays where it is while BenchmarkShadowModes runs, the reference matches every measured frame then
+float shadowCasterAngle = 0.0f;
+double lastShadowReport = 0.0;
+// texels of every cascade, --shadow-size on the command line and shift + X at runtime
+int shadowWidth = 1024, shadowHeight = 1024;
 glm::vec3 lightPos(-2.0f, 4.0f, -1.0f);
 
 float quadVertices[] = { // vertex attributes for a quad that fills the entire screen in Normalized Device Coordinates.
@@ -199,8 +276,10 @@ void loadShaders()
 		delete marchingCubesShader;
 		delete displacementShader;
 		delete particleRenderShader;
+		delete particleBillboardShader;
 		delete particleTransformShader;
 		delete densityComputeShader;
+		delete densityEditShader;
 	}
 
 	marchingCubesShader = new Shader("Shaders/vertexShader.glsl", "Shaders/fragmentShader.glsl", "Shaders/geometryShader.glsl");
@@ -208,6 +287,7 @@ void loadShaders()
 
 	// Particle shader
 	particleRenderShader = new Shader("Shaders/particleRenderVS.glsl", "Shaders/particleRenderPS.glsl", "Shaders/particleRenderGS.glsl");
+	particleBillboardShader = new Shader("Shaders/particleBillboardVS.glsl", "Shaders/particleRenderPS.glsl");
 
 	const GLchar* varyings[4];
 	varyings[0] = "outPosition";
@@ -218,6 +298,7 @@ void loadShaders()
 	particleTransformShader = new Shader("Shaders/particleTransformVS.glsl", "Shaders/particleTransformPS.glsl", "Shaders/particleTransformGS.glsl", varyings, 4);
 
 	densityComputeShader = new Shader("Shaders/densityCS.glsl");
+	densityEditShader = new Shader("Shaders/densityEditCS.glsl");
 
 	// Shadow Mapping
 	storeDepthShader = new Shader("Shaders/storeDepthVS.glsl", "Shaders/storeDepthPS.glsl");
@@ -232,11 +313,18 @@ void loadShaders()
 	VSMShader->setInt("shadowMap", 1);
 	debugShader->use();
 	debugShader->setInt("depthMap", 0);
+
+	if (computeParticles != nullptr)
+		computeParticles->LoadShaders();
+	if (varianceShadowMap != nullptr)
+		varianceShadowMap->LoadShaders();
+	if (particleTransparency != nullptr)
+		particleTransparency->LoadShaders();
 }
 
-void SetupParticles()
+// The emitters every particle mode starts from
+void InitialParticles(particlestruct* particles)
 {
-	auto* particles = new particlestruct[MAX_PARTICLES];
 	for (int i = 0; i < EMITTER_COUNT; i++)
 	{
 		//position
@@ -251,65 +339,544 @@ void SetupParticles()
 		//type
 		particles[i].type = 0.f;
 	}
+}
 
+void SetupParticles()
+{
+	auto* particles = new particlestruct[MAX_PARTICLES];
+	InitialParticles(particles);
 
+	particleBuffers = new ParticleBufferRing(MAX_PARTICLES, PARTICLE_BUFFER_DEPTH, particles, MAX_PARTICLES);
 
-	glGenBuffers(2, particleVBO);
-	glGenTransformFeedbacks(2, particleTFB);
-	for (unsigned int i = 0; i < 2; i++) {
-		glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, particleTFB[i]);
-		glBindBuffer(GL_ARRAY_BUFFER, particleVBO[i]);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(particlestruct) * MAX_PARTICLES, particles, GL_DYNAMIC_DRAW);
-		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, particleVBO[i]);
-	}
+	// the CPU simulation starts from the same emitters
+	particleSimulator = new ParticleSimulator(MAX_PARTICLES);
+	particleSimulator->Reset(particles, EMITTER_COUNT);
+	particlePool = new ParticlePool(MAX_PARTICLES);
+	particlePool->Reset(particles, EMITTER_COUNT);
+	particleUpload.resize(MAX_PARTICLES);
+
+	computeParticles = new ComputeParticleSystem(MAX_PARTICLES);
+	computeParticles->Reset(particles, EMITTER_COUNT);
+
+	particleForceField = new ForceField();
+	particlePool->TurbulenceField = particleForceField;
+	computeParticles->TurbulenceField = particleForceField;
+
+	particleUpdateTimer = new GpuTimer();
+	particleRenderTimer = new GpuTimer();
+	particleFeedbackCounter = new TransformFeedbackCounter();
 
 	delete[] particles;
+}
 
-	/*glGenVertexArrays(1, &particleVAO);
-	glBindVertexArray(particleVAO);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT) * 8, 0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT) * 8, (void*)(sizeof(float) * 3));
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT) * 8, (void*)(sizeof(float) * 6));
-	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(GL_FLOAT) * 8, (void*)(sizeof(float) * 7));
-	glBindVertexArray(0);*/
+// Starts every particle mode over from the emitters. The modes share the buffer ring, so whatever one left in
+// it means nothing to the next, and the transform feedback counts are from before the switch.
+void ResetParticles()
+{
+	particlestruct particles[EMITTER_COUNT];
+	InitialParticles(particles);
+
+	particleBuffers->Restart(particles, EMITTER_COUNT);
+	// the first transform feedback update draws the emitters instead of the stale feedback count
+	isFirstRender = true;
+	particleUploadCount = 0;
+	particleFeedbackCounter->Reset();
+
+	particleSimulator->Reset(particles, EMITTER_COUNT);
+	particlePool->Reset(particles, EMITTER_COUNT);
+	computeParticles->Reset(particles, EMITTER_COUNT);
+	spawnParticles = false;
+}
+
+// Particles dropped by the current mode because its buffers were full
+unsigned int ParticleOverflow()
+{
+	switch (particleMode)
+	{
+	case CPU_SIMULATION:
+		return particleSimulator->Overflow();
+	case CPU_POOL:
+		return particlePool->Overflow();
+	case COMPUTE_SHADER:
+		computeParticles->PollCounters();
+		return computeParticles->Counters().overflowCount;
+	default:
+		particleFeedbackCounter->Poll();
+		return (unsigned int)particleFeedbackCounter->Overflow();
+	}
+}
+
+// Particles alive after the last update, for transform feedback and compute shaders after the latest update counted
+// without waiting
+int ParticleCount()
+{
+	switch (particleMode)
+	{
+	case CPU_SIMULATION:
+		return particleSimulator->Count();
+	case CPU_POOL:
+		return particlePool->Count();
+	case COMPUTE_SHADER:
+		computeParticles->PollCounters();
+		return computeParticles->Counters().aliveCount;
+	default:
+		particleFeedbackCounter->Poll();
+		return (int)particleFeedbackCounter->Written();
+	}
+}
+
+// Waits for the GPU and returns the time in milliseconds, replays time each pass with it
+double FinishedMilliseconds()
+{
+	glFinish();
+	return glfwGetTime() * 1000.0;
+}
+
+// Gameplay style query on the CPU copy of the particles, which is a few frames old but never waits for the GPU
+void ReportParticlesNearSpawn()
+{
+	unsigned int count, age;
+	const particlestruct* particles = particleBuffers->Readback(count, age);
+	if (particles == nullptr)
+	{
+		std::cout << "Particle readback: no finished copy yet" << std::endl;
+		return;
+	}
+
+	const float radius = 2.0f;
+	unsigned int nearby = 0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		glm::vec3 offset = particles[i].position - spawnParticlePosition;
+		if (glm::dot(offset, offset) < radius * radius)
+			nearby++;
+	}
+	std::cout << "Particle readback (" << (particleBuffers->PersistentlyMapped() ? "persistently mapped" : "copied") << ", " << age
+		<< " frames old): " << nearby << " of " << count << " particles within " << radius << " of the spawn position" << std::endl;
+}
+
+// Prints the GPU time of the particle passes every few seconds and keeps the average of the current mode
+void ReportParticleStats()
+{
+	particleModeUpdateTimes[particleMode] = particleUpdateTimer->AverageMilliseconds();
+	particleModeRenderTimes[particleMode] = particleRenderTimer->AverageMilliseconds();
+
+	if (glfwGetTime() - lastParticleReport < 2.0f)
+		return;
+	lastParticleReport = glfwGetTime();
+
+	std::cout << "Particle GPU time (update / render):";
+	for (int mode = 0; mode < PARTICLE_MODE_COUNT; mode++)
+	{
+		std::cout << " " << particleModeNames[mode] << " " << particleModeUpdateTimes[mode] << " / " << particleModeRenderTimes[mode] << " ms"
+			<< (mode == particleMode ? " (current)" : "") << (mode + 1 < PARTICLE_MODE_COUNT ? "," : "");
+	}
+	std::cout << std::endl;
+
+	if (particleMode == COMPUTE_SHADER && computeParticles->Culling)
+	{
+		computeParticles->PollCounters();
+		std::cout << "Particles drawn after culling: " << computeParticles->DrawCount() << " of " << computeParticles->Counters().aliveCount
+			<< ", " << computeParticles->CounterLatency() << " updates behind" << std::endl;
+	}
+
+	if (particleMode == COMPUTE_SHADER && computeParticles->Trails.Enabled)
+	{
+		computeParticles->PollCounters();
+		if (computeParticles->Counters().traillessCount > 0)
+			std::cout << "Particle trails: " << computeParticles->Counters().traillessCount << " emitters without a trail, their probe windows of the "
+				<< computeParticles->TrailBuffers().TrailCount() << " trails were full" << std::endl;
+	}
+
+	if (particleMode != COMPUTE_SHADER)
+	{
+		std::cout << "Particle buffer ring of " << particleBuffers->Depth() << ": " << particleBuffers->Stalls() << " stalls, "
+			<< particleBuffers->StallMilliseconds() << " ms waited" << std::endl;
+		particleBuffers->Reset();
+		if (particleBuffers->ReadbackEnabled)
+			ReportParticlesNearSpawn();
+	}
+
+	if (particleMode == TRANSFORM_FEEDBACK)
+	{
+		particleFeedbackCounter->Poll();
+		std::cout << "Transform feedback particles: " << particleFeedbackCounter->Written() << " of " << MAX_PARTICLES << " written, "
+			<< particleFeedbackCounter->Generated() << " generated, " << particleFeedbackCounter->Latency() << " frames behind, "
+			<< particleFeedbackCounter->TotalOverflow() << " dropped over " << particleFeedbackCounter->Samples() << " frames" << std::endl;
+		particleFeedbackCounter->Reset();
+	}
+
+	unsigned int overflow = ParticleOverflow();
+	if (overflow > 0)
+		std::cout << "Particle overflow: " << overflow << " particles dropped by " << particleModeNames[particleMode] << std::endl;
+}
+
+// Runs one particle update, either as transform feedback pass or on the CPU
+void UpdateParticles()
+{
+	if (particleMode == CPU_SIMULATION || particleMode == CPU_POOL)
+	{
+		if (particleMode == CPU_SIMULATION)
+		{
+			particleSimulator->Update(deltaTime, spawnParticles, spawnParticlePosition);
+			particleSimulator->CopyTo(particleUpload.data());
+			particleUploadCount = particleSimulator->Count();
+		}
+		else
+		{
+			particlePool->Update(deltaTime, spawnParticles, spawnParticlePosition);
+			particleUploadCount = particlePool->CopyTo(particleUpload.data());
+		}
+		spawnParticles = false;
+
+		particleBuffers->AcquireTarget();
+		glBindBuffer(GL_ARRAY_BUFFER, particleBuffers->TargetBuffer());
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(particlestruct) * particleUploadCount, particleUpload.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return;
+	}
+
+	if (particleMode == COMPUTE_SHADER)
+	{
+		computeParticles->Update(deltaTime, spawnParticles, spawnParticlePosition);
+		spawnParticles = false;
+		return;
+	}
+
+	particleTransformShader->use();
+	particleTransformShader->setFloat("deltaTime", deltaTime);
+	particleTransformShader->setInt("frame", particleFrame++);
+	particleTransformShader->setBool("spawnNewEmitter", spawnParticles);
+	particleTransformShader->setVec3("spawnPosition", spawnParticlePosition);
+	spawnParticles = false;
+
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBindVertexArray(particleBuffers->SourceVertexArray());
+	glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, particleBuffers->TargetFeedback());
+	// the counts only feed the stats, the draws take theirs from the feedback object
+	particleFeedbackCounter->Begin();
+	glBeginTransformFeedback(GL_POINTS);
+	// the first update has no feedback yet to take the count from
+	if (isFirstRender)
+	{
+		glDrawArrays(GL_POINTS, 0, EMITTER_COUNT);
+		isFirstRender = false;
+	}
+	else
+	{
+		glDrawTransformFeedback(GL_POINTS, particleBuffers->SourceFeedback());
+	}
+	glEndTransformFeedback();
+	particleFeedbackCounter->End();
+	glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+	glBindVertexArray(0);
+	glDisable(GL_RASTERIZER_DISCARD);
+}
+
+// Draws the particles written by the last update and swaps the particle buffers
+void RenderParticles(const glm::mat4& projection, const glm::mat4& view)
+{
+	if (particleMode == COMPUTE_SHADER)
+	{
+		computeParticles->Render(projection, view, floatingOrigin.SectorTransform(0));
+		return;
+	}
+
+	// the transform feedback count stays on the GPU, so only the CPU particles can be drawn instanced
+	bool billboards = billboardParticles && (particleMode == CPU_SIMULATION || particleMode == CPU_POOL);
+	bool sorted = particleMode == CPU_SIMULATION && sortParticles;
+
+	Shader* shader = billboards ? particleBillboardShader : particleRenderShader;
+	shader->use();
+	shader->setMat4("projection", projection);
+	shader->setMat4("view", view);
+	// particles are simulated in sector 0
+	shader->setMat4("model", floatingOrigin.SectorTransform(0));
+	shader->setInt("blendMode", particleBlending);
+	shader->setFloat("opacity", PARTICLE_OPACITY);
+
+	// the back to front draw order goes into the element buffer of the target, which UpdateParticles acquired
+	glBindVertexArray(particleBuffers->TargetVertexArray());
+	if (sorted)
+	{
+		particleSimulator->SortBackToFront(view * floatingOrigin.SectorTransform(0));
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(unsigned int) * particleUploadCount, particleSimulator->DrawOrder().data());
+	}
+
+	if (billboards)
+	{
+		// the vertex buffer is pulled as storage buffer, the draw order comes from the element buffer
+		shader->setBool("drawListed", sorted);
+		shader->setBool("packedParticles", false);
+		shader->setFloat("particleSize", PARTICLE_BILLBOARD_SIZE);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers->TargetBuffer());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, particleBuffers->TargetIndexBuffer());
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, particleUploadCount);
+	}
+	else if (sorted)
+		glDrawElements(GL_POINTS, particleUploadCount, GL_UNSIGNED_INT, 0);
+	else if (particleMode == CPU_SIMULATION || particleMode == CPU_POOL)
+		glDrawArrays(GL_POINTS, 0, particleUploadCount);
+	else
+		glDrawTransformFeedback(GL_POINTS, particleBuffers->TargetFeedback());
+	glBindVertexArray(0);
+
+	// the transform feedback count is only known a few frames late, the readback may hold a stale tail then
+	unsigned int count = particleMode == TRANSFORM_FEEDBACK ? (unsigned int)particleFeedbackCounter->Written() : particleUploadCount;
+	particleBuffers->Advance(std::min(count, MAX_PARTICLES));
 }
 
 void SetupFBOs()
 {
-	glGenFramebuffers(1, &depthMapFBO);
-
-	glGenTextures(1, &depthMap);
-	glBindTexture(GL_TEXTURE_2D, depthMap);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_RGB, GL_FLOAT, 0);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	float borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-	// attach depth texture as FBO's depth buffer
-	glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-	//glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, depthMap, 0);
-	glDrawBuffer(GL_COLOR_ATTACHMENT0);
-	glReadBuffer(GL_NONE);
+	varianceShadowMap = new VarianceShadowMap(shadowWidth, shadowHeight, shadowCascades.CascadeCount());
+}
+
+// Prints the GPU time of the shadow map filtering and how much of the cache was redrawn every few seconds
+void ReportShadowStats()
+{
+	if (glfwGetTime() - lastShadowReport < 2.0f)
+		return;
+	lastShadowReport = glfwGetTime();
+
+	std::cout << "Shadow map filter GPU time (" << shadowModeNames[varianceShadowMap->Mode()]
+		<< (varianceShadowMap->FullPrecision() ? " 32 bit" : " 16 bit") << ", blur radius " << varianceShadowMap->BlurRadius
+		<< " + mipmaps): " << varianceShadowMap->FilterMilliseconds() << " ms" << std::endl;
+	std::cout << "Shadow cache: " << varianceShadowMap->StaticRenders() << " static layers redrawn, "
+		<< varianceShadowMap->Filters() << " of " << varianceShadowMap->Frames() << " frames filtered" << std::endl;
+	std::cout << "Shadow cascade splits:";
+	for (int cascade = 0; cascade < shadowCascades.CascadeCount(); cascade++)
+		std::cout << " " << shadowCascades.SplitDistance(cascade);
+	std::cout << std::endl;
+	varianceShadowMap->ResetStats();
+}
+
+// The camera projection of the main loop and the shadow benchmark
+glm::mat4 CameraProjection()
+{
+	return glm::perspective(CAMERA_FOV, CAMERA_ASPECT, CAMERA_NEAR, CAMERA_FAR);
+}
+
+// The test scene lives in sector 0, light and scene are moved into origin relative space
+glm::vec3 SceneOrigin()
+{
+	return floatingOrigin.ToLocal(WorldPosition(0, glm::vec3(0.0f)));
+}
+
+// Renders the depth of the test scene into every shadow cascade and filters the moments. The shadows treat the
+// light as directional, shining from lightPos onto the scene origin. The static casters are only redrawn into
+// the cascades whose snapped light space matrix moved, which happens after the camera moved a texel of that
+// cascade. The near cascades with their small texels are redrawn most often, a still camera redraws none
+void RenderShadowMaps(const glm::mat4& view)
+{
+	shadowCascades.Fit(view, CAMERA_FOV, CAMERA_ASPECT, CAMERA_NEAR, -lightPos, varianceShadowMap->Width(), varianceShadowMap->Height());
+	// render scene from light pov
+	storeDepthShader->use();
+	varianceShadowMap->SetUniforms(*storeDepthShader);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, woodTexture);
+	for (int cascade = 0; cascade < shadowCascades.CascadeCount(); cascade++)
+	{
+		if (!varianceShadowMap->BeginStaticPass(cascade, shadowCascades.LightSpaceMatrix(cascade)))
+			continue;
+		storeDepthShader->setMat4("lightSpaceMatrix", shadowCascades.LightSpaceMatrix(cascade));
+		renderStaticCasters(*storeDepthShader);
+	}
+	if (moveShadowCaster)
+	{
+		for (int cascade = 0; cascade < shadowCascades.CascadeCount(); cascade++)
+		{
+			varianceShadowMap->BeginDynamicPass(cascade);
+			storeDepthShader->setMat4("lightSpaceMatrix", shadowCascades.LightSpaceMatrix(cascade));
+			renderDynamicCasters(*storeDepthShader);
+		}
+	}
+	varianceShadowMap->EndShadowPass();
+}
+
+// Uses the lighting shader with the cascades and the filtered moments, renderScene draws with it afterwards
+void UseShadowedLighting(const glm::mat4& projection, const glm::mat4& view)
+{
+	VSMShader->use();
+	VSMShader->setMat4("projection", projection);
+	VSMShader->setMat4("view", view);
+	// set light uniforms
+	VSMShader->setVec3("viewPos", camera.Position);
+	VSMShader->setVec3("lightPos", SceneOrigin() + lightPos);
+	VSMShader->setInt("cascadeCount", shadowCascades.CascadeCount());
+	for (int cascade = 0; cascade < shadowCascades.CascadeCount(); cascade++)
+	{
+		std::string index = "[" + std::to_string(cascade) + "]";
+		VSMShader->setMat4("lightSpaceMatrices" + index, shadowCascades.LightSpaceMatrix(cascade));
+		VSMShader->setFloat("cascadeSplits" + index, shadowCascades.SplitDistance(cascade));
+	}
+	varianceShadowMap->SetUniforms(*VSMShader);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, woodTexture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, varianceShadowMap->Texture());
+}
+
+// Renders the test scene from view in every shadow mode, both precisions and with and without light bleeding
+// reduction. Times the shadow pass with its filtering and the lighting pass, and compares the shadow factors
+// with unfiltered depth compares of 32 bit VSM moments: leak is the mean light inside their umbra, error the
+// mean absolute difference over the whole scene. Filtering softens every edge, so the error never reaches 0
+void BenchmarkShadowModes(const glm::mat4& projection, const glm::mat4& view, unsigned int repetitions)
+{
+	ShadowMode mode = varianceShadowMap->Mode();
+	bool fullPrecision = varianceShadowMap->FullPrecision();
+	int blurRadius = varianceShadowMap->BlurRadius;
+	float lightBleedingReduction = varianceShadowMap->LightBleedingReduction;
+
+	// shadow factors of the whole screen, read back for the comparison
+	GLuint visibilityTexture, depthBuffer, framebuffer;
+	glGenTextures(1, &visibilityTexture);
+	glBindTexture(GL_TEXTURE_2D, visibilityTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, SCR_WIDTH, SCR_HEIGHT);
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, SCR_WIDTH, SCR_HEIGHT);
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, visibilityTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// timestamps, GpuTimer already measures the filtering inside the shadow pass with an elapsed time query
+	GLuint queries[3];
+	glGenQueries(3, queries);
+
+	auto renderVisibility = [&](bool hard, std::vector<float>& visibility) {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+		// the background stays negative and is left out of the comparison
+		GLfloat background[] = { -1.0f, -1.0f, -1.0f, -1.0f };
+		glClearBufferfv(GL_COLOR, 0, background);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		UseShadowedLighting(projection, view);
+		VSMShader->setBool("visibilityOnly", true);
+		VSMShader->setBool("hardShadows", hard);
+		renderScene(*VSMShader);
+		VSMShader->setBool("visibilityOnly", false);
+		VSMShader->setBool("hardShadows", false);
+		visibility.resize(SCR_WIDTH * SCR_HEIGHT);
+		glReadPixels(0, 0, SCR_WIDTH, SCR_HEIGHT, GL_RED, GL_FLOAT, visibility.data());
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	};
+
+	std::vector<float> reference, visibility;
+	varianceShadowMap->SetMode(SHADOW_VSM, true);
+	varianceShadowMap->InvalidateStatic();
+	varianceShadowMap->BlurRadius = 0;
+	RenderShadowMaps(view);
+	renderVisibility(true, reference);
+	varianceShadowMap->BlurRadius = blurRadius;
+
+	std::cout << "Shadow mode benchmark, blur radius " << blurRadius << ", " << repetitions << " repetitions" << std::endl;
+	for (int benchmarkMode = 0; benchmarkMode < SHADOW_MODE_COUNT; benchmarkMode++)
+	{
+		for (bool benchmarkPrecision : { false, true })
+		{
+			varianceShadowMap->SetMode(ShadowMode(benchmarkMode), benchmarkPrecision);
+			for (float reduction : { 0.0f, lightBleedingReduction })
+			{
+				varianceShadowMap->LightBleedingReduction = reduction;
+				GLuint64 shadowNanoseconds = 0, lightingNanoseconds = 0;
+				for (unsigned int repetition = 0; repetition < repetitions; repetition++)
+				{
+					// the uncached cost, a still camera would redraw nothing
+					varianceShadowMap->InvalidateStatic();
+					glQueryCounter(queries[0], GL_TIMESTAMP);
+					RenderShadowMaps(view);
+					glQueryCounter(queries[1], GL_TIMESTAMP);
+					glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+					glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+					UseShadowedLighting(projection, view);
+					renderScene(*VSMShader);
+					glQueryCounter(queries[2], GL_TIMESTAMP);
+
+					GLuint64 timestamps[3];
+					for (int i = 0; i < 3; i++)
+						glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &timestamps[i]);
+					shadowNanoseconds += timestamps[1] - timestamps[0];
+					lightingNanoseconds += timestamps[2] - timestamps[1];
+				}
+
+				renderVisibility(false, visibility);
+				double leak = 0.0, error = 0.0;
+				size_t umbra = 0, covered = 0;
+				for (size_t i = 0; i < reference.size(); i++)
+				{
+					if (reference[i] < 0.0f)
+						continue;
+					covered++;
+					error += std::abs(visibility[i] - reference[i]);
+					if (reference[i] == 0.0f)
+					{
+						umbra++;
+						leak += visibility[i];
+					}
+				}
+
+				std::cout << shadowModeNames[benchmarkMode] << (benchmarkPrecision ? " 32 bit" : " 16 bit")
+					<< ", light bleeding reduction " << reduction << ": shadow pass "
+					<< double(shadowNanoseconds) / 1000000.0 / repetitions << " ms, lighting "
+					<< double(lightingNanoseconds) / 1000000.0 / repetitions << " ms, "
+					<< varianceShadowMap->MemoryBytes() / (1024 * 1024) << " MB, leak "
+					<< (umbra > 0 ? leak / umbra : 0.0) << ", error " << (covered > 0 ? error / covered : 0.0) << std::endl;
+			}
+		}
+	}
+
+	varianceShadowMap->SetMode(mode, fullPrecision);
+	varianceShadowMap->LightBleedingReduction = lightBleedingReduction;
+	glDeleteQueries(3, queries);
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteRenderbuffers(1, &depthBuffer);
+	glDeleteTextures(1, &visibilityTexture);
 }
 
-int main()
+// Command line:
+//   --record <file>    writes the time steps and particle spawns of every frame to file
+//   --replay <file>    plays file back with a frozen camera, writes per frame stats to <file>.csv and quits at its end
+//   --timestep <s>     replays with a fixed time step instead of the recorded ones
+//   --mode <0-3>       particle mode to start in, see Particle_Mode
+//   --headless         hidden window without vsync, frames run back to back
+//   --shadow-size <n>  width and height of the shadow cascades in texels
+int main(int argc, char* argv[])
 {
 	srand(time(NULL));
 
+	std::string recordPath, replayPath;
+	float replayTimestep = 0.0f;
+	bool headless = false;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (argument == "--record" && hasValue)
+			recordPath = argv[++i];
+		else if (argument == "--replay" && hasValue)
+			replayPath = argv[++i];
+		else if (argument == "--timestep" && hasValue)
+			replayTimestep = float(atof(argv[++i]));
+		else if (argument == "--mode" && hasValue)
+			particleMode = Particle_Mode(std::min(std::max(atoi(argv[++i]), 0), PARTICLE_MODE_COUNT - 1));
+		else if (argument == "--headless")
+			headless = true;
+		else if (argument == "--shadow-size" && hasValue)
+			shadowWidth = shadowHeight = std::min(std::max(atoi(argv[++i]), 16), 8192);
+		else
+			std::cout << "ERROR::COMMAND_LINE::UNKNOWN_ARGUMENT " << argument << std::endl;
+	}
+
 	// glfw: initialize and configure
 	// ------------------------------
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	if (headless)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
 	// glfw window creation
 	// --------------------
@@ -321,6 +888,8 @@ int main()
 		return -1;
 	}
 	glfwMakeContextCurrent(window);
+	if (headless)
+		glfwSwapInterval(0);
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 	glfwSetCursorPosCallback(window, mouse_callback);
 	glfwSetScrollCallback(window, scroll_callback);
@@ -400,6 +969,32 @@ int main()
 	// Creates the two density textures
 	SetupFBOs();
 	loadShaders();
+	densityJournal = new DensityJournal(glm::ivec3(textureWidth, textureHeight, textureDepth));
+	SetupParticles();
+	particleTransparency = new ParticleTransparency(SCR_WIDTH, SCR_HEIGHT, CAMERA_NEAR, CAMERA_FAR, renderQuad);
+	particleTransparency->SpriteTexture = loadTexture("textures/clipart-mist-3.jpg");
+
+	// the floor of the test scene is the emission surface until the tunnel surface of sector 0 is loaded
+	std::vector<glm::vec3> floorTriangles;
+	for (int i = 0; i < 6; i++)
+		floorTriangles.push_back(glm::vec3(planeVertices[i * 8], planeVertices[i * 8 + 1], planeVertices[i * 8 + 2]));
+	particleSurface = new EmissionSurface();
+	particleSurface->Build(floorTriangles);
+	computeParticles->Surface = particleSurface;
+
+	if (!recordPath.empty())
+		particleRecorder = new ParticleRecorder(recordPath);
+	if (!replayPath.empty())
+	{
+		particleReplay = new ParticleReplay(replayPath, replayTimestep);
+		if (!particleReplay->Valid())
+		{
+			delete particleReplay;
+			particleReplay = nullptr;
+		}
+		else
+			std::cout << "Replaying " << particleReplay->Frames() << " frames with " << particleModeNames[particleMode] << std::endl;
+	}
 	//glEnable(GL_TEXTURE_3D);
 	//glGenTextures(1, &densityTextureA);
 	//glBindTexture(GL_TEXTURE_3D, densityTextureA);
@@ -455,7 +1050,7 @@ int main()
 	//glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	//____________________TEXTURES__________________
-	unsigned int woodTexture = loadTexture("textures/wood.png");
+	woodTexture = loadTexture("textures/wood.png");
 
 	/*int width, height, nrChannels;
 
@@ -515,19 +1110,27 @@ int main()
 		float currentFrame = glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
+		shadowCasterAngle = currentFrame * 0.5f;
 
-		processInput(window);
-
-		// Adjusts the camera sector, depending on the position
-		if (camera.Position.z < (cameraSector * cameraSectorHeight) + reloadLowerSectorBound)
+		// a replay takes over the time step and the particle spawns and ends the program after its last frame
+		ParticleFrame replayFrame;
+		if (particleReplay != nullptr)
 		{
-			cameraSector--;
-		}
-		if (camera.Position.z > (cameraSector * cameraSectorHeight) + reloadUpperSectorBound)
-		{
-			cameraSector++;
+			if (!particleReplay->Next(replayFrame))
+			{
+				particleReplay->PrintSummary(particleModeNames[particleMode]);
+				break;
+			}
+			deltaTime = replayFrame.deltaTime;
 		}
 
+		processInput(window);
+
+		// Adjusts the camera sector, depending on the position. The camera position is kept relative
+		// to the origin sector, so the origin is moved along instead of letting the position grow.
+		floatingOrigin.Rebase(camera.Position);
+		cameraSector = floatingOrigin.Sector;
+
 		//if (reload || previousCameraSector != cameraSector)
 		//{
 		//	reload = false;
@@ -542,6 +1145,7 @@ int main()
 
 		//	glDispatchCompute(textureWidth, textureHeight, textureDepth);
 		//	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		//	densityJournal->Apply(cameraSector, densityTextureA, *densityEditShader);
 
 		//	// Second pass for density texture B
 		//	densityComputeShader->setInt("texturePosition", cameraSector - 1);
@@ -550,6 +1154,23 @@ int main()
 
 		//	glDispatchCompute(textureWidth, textureHeight, textureDepth);
 		//	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		//	densityJournal->Apply(cameraSector - 1, densityTextureB, *densityEditShader);
+
+		//	// Sectors out of reach are dropped from memory, their edits stay in the journal files
+		//	densityJournal->Retain(cameraSector - 1, cameraSector);
+
+		//	// Particles live in sector 0 and collide with its density while it is loaded
+		//	GLuint particleTerrain = cameraSector == 0 ? densityTextureA : (cameraSector - 1 == 0 ? densityTextureB : 0);
+		//	computeParticles->TerrainTexture = particleTerrain;
+		//	computeParticles->TerrainDimensions = glm::vec3(textureWidth, textureHeight, textureDepth);
+		//	if (particleTerrain != 0) {
+		//		std::vector<float> particleTerrainDensity(textureWidth * textureHeight * textureDepth);
+		//		glBindTexture(GL_TEXTURE_3D, particleTerrain);
+		//		glGetTexImage(GL_TEXTURE_3D, 0, GL_RED, GL_FLOAT, particleTerrainDensity.data());
+		//		particlePool->Grid().SetTerrain(particleTerrainDensity.data(), glm::ivec3(textureWidth, textureHeight, textureDepth), 1.0f);
+		//		// the sector mesh changed, surface bursts spread over the new tunnel walls
+		//		particleSurface->Build(EmissionSurface::ExtractSurface(particleTerrainDensity.data(), glm::ivec3(textureWidth, textureHeight, textureDepth)));
+		//	}
 		//}
 
 		// render
@@ -558,7 +1179,7 @@ int main()
 		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		glm::mat4 projection = glm::perspective(glm::radians(60.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 300.0f);
+		glm::mat4 projection = CameraProjection();
 		glm::mat4 view = camera.GetViewMatrix();
 
 		// Configuring of marching cube shader
@@ -593,17 +1214,16 @@ int main()
 		//marchingCubesShader->setMat4("projection", projection);
 		//marchingCubesShader->setMat4("view", view);
 		//marchingCubesShader->setVec3("viewPos", camera.Position);
-		//glm::mat4 model = glm::mat4(1.0f);
-		//marchingCubesShader->setMat4("model", model);
+		//marchingCubesShader->setFloat("textureOrigin", floatingOrigin.TextureOffset(0.02f));
 		//glBindVertexArray(VAO);
 
 		//// First pass for density texture A
-		//marchingCubesShader->setInt("cameraSector", cameraSector);
+		//marchingCubesShader->setMat4("model", floatingOrigin.SectorTransform(cameraSector));
 		//glBindTexture(GL_TEXTURE_3D, densityTextureA);
 		//glDrawArraysInstanced(GL_POINTS, 0, (textureWidth - 1) * (textureHeight - 1), textureDepth);
 
 		//// Second pass for density texture B
-		//marchingCubesShader->setInt("cameraSector", cameraSector - 1);
+		//marchingCubesShader->setMat4("model", floatingOrigin.SectorTransform(cameraSector - 1));
 		//glBindTexture(GL_TEXTURE_3D, densityTextureB);
 		//glDrawArraysInstanced(GL_POINTS, 0, (textureWidth - 1) * (textureHeight - 1), textureDepth - 1);
 
@@ -626,28 +1246,15 @@ int main()
 		//displacementShader->setInt("secondaryLayers", secondaryLayers);
 		//displacementShader->setMat4("projection", projection);
 		//displacementShader->setMat4("view", view);
+		//glm::mat4 model = floatingOrigin.SectorTransform(0);
 		//model = glm::translate(model, glm::vec3(0, 0, -1));
 		//model = glm::scale(model, glm::vec3(10));
 		//displacementShader->setMat4("model", model);
 		//displacementShader->setVec3("viewPos", camera.Position);
 
-		// 1. render depth of scene to texture (light POV)
-		glm::mat4 lightProjection, lightView, lightSpaceMatrix;
-		float near_plane = 1.0f, far_plane = 7.5f;
-		lightProjection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, near_plane, far_plane);
-		lightView = glm::lookAt(lightPos, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		lightSpaceMatrix = lightProjection * lightView;
-		// render scene from light pov
-		storeDepthShader->use();
-		storeDepthShader->setMat4("lightSpaceMatrix", lightSpaceMatrix);
-
-		glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-		glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-		glClear(GL_DEPTH_BUFFER_BIT);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, woodTexture);
-		renderScene(*storeDepthShader);
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		// 1. render depth of scene to texture (light POV), once per cascade
+		RenderShadowMaps(view);
+		ReportShadowStats();
 
 		// reset viewport
 		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
@@ -657,18 +1264,33 @@ int main()
 		// -------------------------------------------------------
 		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		VSMShader->use();
-		VSMShader->setMat4("projection", projection);
-		VSMShader->setMat4("view", view);
-		// set light uniforms
-		VSMShader->setVec3("viewPos", camera.Position);
-		VSMShader->setVec3("lightPos", lightPos);
-		VSMShader->setMat4("lightSpaceMatrix", lightSpaceMatrix);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, woodTexture);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, depthMap);
+		UseShadowedLighting(projection, view);
 		renderScene(*VSMShader);
+
+		// particles
+		if (particleReplay != nullptr)
+		{
+			spawnParticles = replayFrame.spawn;
+			spawnParticlePosition = replayFrame.spawnPosition;
+		}
+		if (particleRecorder != nullptr)
+			particleRecorder->Record({ deltaTime, spawnParticles, spawnParticlePosition });
+
+		computeParticles->SetCamera(projection, view, floatingOrigin.SectorTransform(0), (float)SCR_HEIGHT);
+		double updateStart = particleReplay != nullptr ? FinishedMilliseconds() : 0.0;
+		particleUpdateTimer->Begin();
+		UpdateParticles();
+		particleUpdateTimer->End();
+		double renderStart = particleReplay != nullptr ? FinishedMilliseconds() : 0.0;
+		particleRenderTimer->Begin();
+		particleTransparency->Begin(particleBlending);
+		RenderParticles(projection, view);
+		particleTransparency->End(particleBlending);
+		particleRenderTimer->End();
+		if (particleReplay != nullptr)
+			particleReplay->WriteStats(ParticleCount(), renderStart - updateStart, FinishedMilliseconds() - renderStart);
+		ReportParticleStats();
+
 		/*basicShader->use();
 		basicShader->setMat4("projection", projection);
 		basicShader->setMat4("view", view);
@@ -678,16 +1300,15 @@ int main()
 		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_2D, woodTexture);
 		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, depthMap);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, varianceShadowMap->Texture());
 		renderScene(*basicShader);*/
 
 		// render Depth map to quad for visual debugging
 		// ---------------------------------------------
 		debugShader->use();
-		debugShader->setFloat("near_plane", near_plane);
-		debugShader->setFloat("far_plane", far_plane);
+		debugShader->setInt("layer", 0);
 		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, depthMap);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, varianceShadowMap->Texture());
 		//renderQuad();
 		
 
@@ -697,6 +1318,9 @@ int main()
 		glfwPollEvents();
 	}
 
+	delete particleRecorder;
+	delete particleReplay;
+
 	// glfw: terminate, clearing all previously allocated GLFW resources.
 	// ------------------------------------------------------------------
 	glfwTerminate();
@@ -708,23 +1332,32 @@ int main()
 // --------------------
 void renderScene(const Shader& shader)
 {
+	renderStaticCasters(shader);
+	renderDynamicCasters(shader);
+}
+
+// the floor and the cubes, which never move
+void renderStaticCasters(const Shader& shader)
+{
+	// the scene is placed in sector 0, relative to the floating origin
+	glm::mat4 origin = floatingOrigin.SectorTransform(0);
 	// floor
-	glm::mat4 model = glm::mat4(1.0f);
+	glm::mat4 model = origin;
 	shader.setMat4("model", model);
 	glBindVertexArray(planeVAO);
 	glDrawArrays(GL_TRIANGLES, 0, 6);
 	// cubes
-	model = glm::mat4(1.0f);
+	model = origin;
 	model = glm::translate(model, glm::vec3(0.0f, 1.5f, 0.0));
 	model = glm::scale(model, glm::vec3(0.5f));
 	shader.setMat4("model", model);
 	renderCube();
-	model = glm::mat4(1.0f);
+	model = origin;
 	model = glm::translate(model, glm::vec3(2.0f, 0.0f, 1.0));
 	model = glm::scale(model, glm::vec3(0.5f));
 	shader.setMat4("model", model);
 	renderCube();
-	model = glm::mat4(1.0f);
+	model = origin;
 	model = glm::translate(model, glm::vec3(-1.0f, 0.0f, 2.0));
 	model = glm::rotate(model, glm::radians(60.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
 	model = glm::scale(model, glm::vec3(0.25));
@@ -732,6 +1365,19 @@ void renderScene(const Shader& shader)
 	renderCube();
 }
 
+// the cube circling over the scene while moveShadowCaster is on
+void renderDynamicCasters(const Shader& shader)
+{
+	if (!moveShadowCaster)
+		return;
+	glm::mat4 model = floatingOrigin.SectorTransform(0);
+	model = glm::translate(model, glm::vec3(2.5f * std::cos(shadowCasterAngle), 1.0f, 2.5f * std::sin(shadowCasterAngle)));
+	model = glm::rotate(model, shadowCasterAngle * 2.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+	model = glm::scale(model, glm::vec3(0.3f));
+	shader.setMat4("model", model);
+	renderCube();
+}
+
 // renderCube() renders a 1x1 3D cube in NDC.
 // -------------------------------------------------
 unsigned int cubeVAO = 0;
@@ -847,6 +1493,10 @@ void processInput(GLFWwindow * window)
 		glfwSetWindowShouldClose(window, true);
 	}
 
+	// the camera stays put during a replay, so culling sees the same view every run
+	if (particleReplay != nullptr)
+		return;
+
 	if (gameMode == CREATE) {
 		if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
 			camera.ProcessKeyboard(FORWARD, deltaTime);
@@ -877,7 +1527,7 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 {
 	if (key == GLFW_KEY_ENTER && action == GLFW_PRESS && gameMode == CREATE) {
 		gameMode = RIDE;
-		camera.Position = waypoints[0];
+		camera.Position = floatingOrigin.ToLocal(waypoints[0]);
 		camera.Orientation = orientations[0];
 	}
 
@@ -889,6 +1539,158 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 		msaa = !msaa;
 	}
 
+	// Terrain editing, E carves and F fills at the point in front of the camera
+	if ((key == GLFW_KEY_E || key == GLFW_KEY_F) && action == GLFW_PRESS && gameMode == CREATE) {
+		WorldPosition brushCenter = floatingOrigin.ToWorld(camera.Position + camera.Front * (brushRadius * 2.0f));
+		densityJournal->AppendBrush(brushCenter, brushRadius, key == GLFW_KEY_E ? -brushStrength : brushStrength, 0.5f);
+		reload = true;
+	}
+
+	// Cycles through transform feedback, CPU, CPU pool and compute shader particles
+	if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+		particleMode = Particle_Mode((particleMode + 1) % PARTICLE_MODE_COUNT);
+		ResetParticles();
+		particleUpdateTimer->Reset();
+		particleRenderTimer->Reset();
+		std::cout << "Particle mode: " << particleModeNames[particleMode] << std::endl;
+	}
+
+	if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+		ParticleSimulator::Benchmark({ MAX_PARTICLES, 1000000, 4000000 }, 100);
+		RadixSort::Benchmark({ MAX_PARTICLES, 1000000, 4000000 }, 10);
+		GpuRadixSort::Benchmark({ MAX_PARTICLES, 1000000, 4000000 }, 10);
+		ComputeParticleSystem::BenchmarkRender({ MAX_PARTICLES, 1000000 }, 10);
+		ComputeParticleSystem::BenchmarkTransparency({ 10000, 100000, MAX_PARTICLES }, { 40.0f, 10.0f, 2.0f }, 10, *particleTransparency);
+		ComputeParticleSystem::BenchmarkSoftParticles({ 10000, 100000, MAX_PARTICLES }, 10, *particleTransparency);
+		BenchmarkShadowModes(CameraProjection(), camera.GetViewMatrix(), 10);
+	}
+
+	// Back to front sorting of the CPU simulation and compute shader particles
+	if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+		sortParticles = !sortParticles;
+		computeParticles->SortBackToFront = sortParticles;
+		std::cout << "Particle sorting: " << (sortParticles ? "on" : "off") << std::endl;
+	}
+
+	// Particle repulsion and terrain collision of the CPU pool and compute shader particles
+	if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+		particlePool->Interaction.Enabled = !particlePool->Interaction.Enabled;
+		computeParticles->Interaction.Enabled = particlePool->Interaction.Enabled;
+		std::cout << "Particle interaction: " << (particlePool->Interaction.Enabled ? "on" : "off") << std::endl;
+	}
+
+	// Curl noise force field of the CPU pool and compute shader particles
+	if (key == GLFW_KEY_U && action == GLFW_PRESS) {
+		particlePool->Turbulence.Enabled = !particlePool->Turbulence.Enabled;
+		computeParticles->Turbulence.Enabled = particlePool->Turbulence.Enabled;
+		std::cout << "Particle turbulence: " << (particlePool->Turbulence.Enabled ? "on" : "off") << std::endl;
+	}
+
+	// Instanced billboards or geometry shader quads for the CPU and compute shader particles
+	if (key == GLFW_KEY_K && action == GLFW_PRESS) {
+		billboardParticles = !billboardParticles;
+		computeParticles->Billboards = billboardParticles;
+		std::cout << "Particle billboards: " << (billboardParticles ? "instanced" : "geometry shader") << std::endl;
+	}
+
+	// Ring of 256 particle bursts in front of the camera, queued as spawn commands of the compute shader particles
+	if (key == GLFW_KEY_N && action == GLFW_PRESS) {
+		glm::vec3 center = camera.Position + camera.Front * 10.0f - floatingOrigin.ToLocal(WorldPosition(0));
+		for (int i = 0; i < 256; i++) {
+			float angle = glm::two_pi<float>() * float(i) / 256.0f;
+			computeParticles->Spawn(center + glm::vec3(cos(angle), 0.0f, sin(angle)) * 5.0f, 64, TYPE_A);
+		}
+	}
+
+	// Dust burst spread uniformly over the emission surface, for the CPU pool and compute shader particles
+	if (key == GLFW_KEY_J && action == GLFW_PRESS) {
+		if (particleMode == CPU_POOL)
+			particlePool->SpawnOnSurface(*particleSurface, 4096, TYPE_A, 0.2f);
+		else if (particleMode == COMPUTE_SHADER)
+			computeParticles->SpawnOnSurface(4096, TYPE_A, 0.2f);
+		// queued up they would all fire the next time the compute shader particles run
+		else
+			std::cout << "Surface emission is not supported by " << particleModeNames[particleMode] << " particles" << std::endl;
+	}
+
+	// Cycles opaque, alpha blended, weighted blended OIT and soft particles, alpha blending wants sorting on (O)
+	if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+		particleBlending = ParticleBlendMode((particleBlending + 1) % PARTICLE_BLEND_MODE_COUNT);
+		computeParticles->Blending = particleBlending;
+		std::cout << "Particle blending: " << particleBlendModeNames[particleBlending] << std::endl;
+	}
+
+	// Blur radius of the variance shadow map, 0, 1, 2, 4, ... up to the largest the blur supports,
+	// with shift the size of the cascades, 512 to 4096 texels
+	if (key == GLFW_KEY_X && action == GLFW_PRESS) {
+		if (mods & GLFW_MOD_SHIFT)
+		{
+			shadowWidth = shadowHeight = shadowWidth >= 4096 ? 512 : std::max(shadowWidth * 2, 512);
+			varianceShadowMap->Resize(shadowWidth, shadowHeight);
+			std::cout << "Shadow map size: " << shadowWidth << " x " << shadowHeight << " x " << varianceShadowMap->Layers() << ", "
+				<< varianceShadowMap->MemoryBytes() / (1024 * 1024) << " MB" << std::endl;
+		}
+		else
+		{
+			int radius = varianceShadowMap->BlurRadius;
+			varianceShadowMap->BlurRadius = radius == 0 ? 1 : radius >= VarianceShadowMap::MAX_BLUR_RADIUS ? 0 : radius * 2;
+			std::cout << "Shadow map blur radius: " << varianceShadowMap->BlurRadius << " texels" << std::endl;
+		}
+		varianceShadowMap->ResetStats();
+	}
+
+	// Shadow mode VSM, EVSM with two and with four moments, with shift between 16 and 32 bit moments
+	if (key == GLFW_KEY_Q && action == GLFW_PRESS) {
+		if (mods & GLFW_MOD_SHIFT)
+			varianceShadowMap->SetMode(varianceShadowMap->Mode(), !varianceShadowMap->FullPrecision());
+		else
+			varianceShadowMap->SetMode(ShadowMode((varianceShadowMap->Mode() + 1) % SHADOW_MODE_COUNT), varianceShadowMap->FullPrecision());
+		std::cout << "Shadow mode: " << shadowModeNames[varianceShadowMap->Mode()] << (varianceShadowMap->FullPrecision() ? ", 32 bit, " : ", 16 bit, ")
+			<< varianceShadowMap->MemoryBytes() / (1024 * 1024) << " MB" << std::endl;
+	}
+
+	// Light bleeding reduction 0, 0.1, ... 0.5, with shift a cube circling over the test scene as a dynamic
+	// shadow caster over the cached static ones
+	if (key == GLFW_KEY_Z && action == GLFW_PRESS) {
+		if (mods & GLFW_MOD_SHIFT)
+		{
+			moveShadowCaster = !moveShadowCaster;
+			std::cout << "Dynamic shadow caster: " << (moveShadowCaster ? "on" : "off") << std::endl;
+		}
+		else
+		{
+			int steps = (int)std::round(varianceShadowMap->LightBleedingReduction * 10.0f);
+			varianceShadowMap->LightBleedingReduction = ((steps + 1) % 6) * 0.1f;
+			std::cout << "Shadow light bleeding reduction: " << varianceShadowMap->LightBleedingReduction << std::endl;
+		}
+	}
+
+	// Ribbon trails behind the compute shader emitters, which wander along the curl noise field meanwhile
+	if (key == GLFW_KEY_I && action == GLFW_PRESS) {
+		computeParticles->Trails.Enabled = !computeParticles->Trails.Enabled;
+		const ParticleTrails& trails = computeParticles->TrailBuffers();
+		std::cout << "Particle trails: " << (computeParticles->Trails.Enabled ? "on" : "off") << ", " << trails.TrailCount() << " trails of "
+			<< trails.Length() << " points, " << trails.MemoryBytes() / 1024 << " KB" << std::endl;
+	}
+
+	// CPU readback of the transform feedback and CPU particles for gameplay queries
+	if (key == GLFW_KEY_Y && action == GLFW_PRESS) {
+		particleBuffers->ReadbackEnabled = !particleBuffers->ReadbackEnabled;
+		std::cout << "Particle readback: " << (particleBuffers->ReadbackEnabled ? "on" : "off") << std::endl;
+	}
+
+	// Resolution divisor of the soft particles, 1, 2 or 4
+	if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+		particleTransparency->Divisor = particleTransparency->Divisor == 4 ? 1 : particleTransparency->Divisor * 2;
+		std::cout << "Soft particle resolution: 1/" << particleTransparency->Divisor << std::endl;
+	}
+
+	// Frustum and screen size culling of the compute shader particles
+	if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+		computeParticles->Culling = !computeParticles->Culling;
+		std::cout << "Particle culling: " << (computeParticles->Culling ? "on" : "off") << std::endl;
+	}
+
 	if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS) wireframeMode = !wireframeMode;
 	if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS) loadShaders(); // Shader hot reloading
 }
@@ -896,14 +1698,17 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 {
 	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && gameMode == CREATE) {
-		waypoints.push_back(camera.Position);
+		waypoints.push_back(floatingOrigin.ToWorld(camera.Position));
 		orientations.push_back(camera.Orientation);
 	}
 
-	if (button == GLFW_MOUSE_BUTTON_MIDDLE)
+	// spawns of a replay come from the recording
+	if (button == GLFW_MOUSE_BUTTON_MIDDLE && particleReplay == nullptr)
 	{
 		std::cout << "PARTICLES" << std::endl;
 		spawnParticles = true;
+		// spawn in front of the camera, in the space of sector 0 the particles live in
+		spawnParticlePosition = camera.Position + camera.Front * 3.0f - floatingOrigin.ToLocal(WorldPosition(0));
 	}
 }
 
@@ -914,6 +1719,8 @@ void framebuffer_size_callback(GLFWwindow * window, int width, int height)
 	// make sure the viewport matches the new window dimensions; note that width and 
 	// height will be significantly larger than specified on retina displays.
 	glViewport(0, 0, width, height);
+	if (particleTransparency != nullptr)
+		particleTransparency->Resize(width, height);
 }
 
 
@@ -937,7 +1744,7 @@ void mouse_callback(GLFWwindow * window, double xpos, double ypos)
 	lastX = xpos;
 	lastY = ypos;
 
-	if (gameMode == CREATE) {
+	if (gameMode == CREATE && particleReplay == nullptr) {
 		camera.ProcessMouseMovement(xoffset, yoffset);
 	}
 
@@ -948,7 +1755,8 @@ void mouse_callback(GLFWwindow * window, double xpos, double ypos)
 // ----------------------------------------------------------------------
 void scroll_callback(GLFWwindow * window, double xoffset, double yoffset)
 {
-	camera.ProcessMouseScroll(yoffset);
+	if (particleReplay == nullptr)
+		camera.ProcessMouseScroll(yoffset);
 }
 
 // utility function for loading a 2D texture from file
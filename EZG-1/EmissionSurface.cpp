@@ -0,0 +1,148 @@
+#include "EmissionSurface.h"
+#include "ParticleRandom.h"
+#include "triangulation.h"
+
+#include <cmath>
+
+static const uint32_t SURFACE_KEY_SALT = 0xA511E9B3u;
+
+// Corners of a marching cubes cell in the order of triTable
+static const glm::ivec3 CORNERS[8] = {
+	{ 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 },
+	{ 0, 0, 1 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 }
+};
+
+// Corners each of the 12 cell edges connects
+static const int EDGE_CORNERS[12][2] = {
+	{ 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 0 },
+	{ 4, 5 }, { 5, 6 }, { 6, 7 }, { 7, 4 },
+	{ 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 }
+};
+
+EmissionSurface::EmissionSurface()
+{
+	glGenBuffers(1, &mTriangleBuffer);
+	glGenBuffers(1, &mAliasTableBuffer);
+}
+
+EmissionSurface::~EmissionSurface()
+{
+	glDeleteBuffers(1, &mTriangleBuffer);
+	glDeleteBuffers(1, &mAliasTableBuffer);
+}
+
+void EmissionSurface::Build(const std::vector<glm::vec3>& vertices)
+{
+	unsigned int count = (unsigned int)(vertices.size() / 3);
+	mTriangles.resize(count);
+	mAliasTable.resize(count);
+	std::vector<float> areas(count);
+	mArea = 0.0f;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		glm::vec3 a = vertices[i * 3], b = vertices[i * 3 + 1], c = vertices[i * 3 + 2];
+		mTriangles[i] = { glm::vec4(a, 1.0f), glm::vec4(b, 1.0f), glm::vec4(c, 1.0f) };
+		areas[i] = 0.5f * glm::length(glm::cross(b - a, c - a));
+		mArea += areas[i];
+	}
+
+	// Vose's alias method: scale the areas to an average of 1, then fill every column below 1 up
+	// with the remainder of a column above 1, which becomes its alias
+	std::vector<unsigned int> small, large;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		areas[i] = mArea > 0.0f ? areas[i] * count / mArea : 1.0f;
+		(areas[i] < 1.0f ? small : large).push_back(i);
+	}
+	while (!small.empty() && !large.empty())
+	{
+		unsigned int less = small.back();
+		small.pop_back();
+		unsigned int more = large.back();
+		mAliasTable[less] = { areas[less], more };
+		areas[more] -= 1.0f - areas[less];
+		if (areas[more] < 1.0f)
+		{
+			large.pop_back();
+			small.push_back(more);
+		}
+	}
+	// what is left is 1 up to rounding errors
+	for (unsigned int i : large)
+		mAliasTable[i] = { 1.0f, i };
+	for (unsigned int i : small)
+		mAliasTable[i] = { 1.0f, i };
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mTriangleBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(SurfaceTriangle) * count, mTriangles.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mAliasTableBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(AliasEntry) * count, mAliasTable.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	mVersion++;
+}
+
+void EmissionSurface::Bind() const
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TRIANGLE_BINDING, mTriangleBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ALIAS_TABLE_BINDING, mAliasTableBuffer);
+}
+
+glm::vec3 EmissionSurface::Sample(uint32_t key) const
+{
+	if (mTriangles.empty())
+		return glm::vec3(0.0f);
+
+	// salted so the position is not correlated with the spawn velocity drawn from the same key
+	uint32_t x = PcgHash(key ^ SURFACE_KEY_SALT);
+	uint32_t y = PcgHash(x);
+	uint32_t z = PcgHash(y);
+	uint32_t w = PcgHash(z);
+
+	// column from the full 32 bits, the same as umulExtended on the GPU
+	unsigned int column = (unsigned int)(((uint64_t)x * mTriangles.size()) >> 32);
+	const AliasEntry& entry = mAliasTable[column];
+	const SurfaceTriangle& triangle = mTriangles[RandomFloat(y) < entry.probability ? column : entry.alias];
+
+	// uniform barycentric coordinates, the square root keeps the density constant towards the corner a
+	float s = std::sqrt(RandomFloat(z));
+	float t = RandomFloat(w);
+	return glm::vec3(triangle.a) * (1.0f - s) + glm::vec3(triangle.b) * (s * (1.0f - t)) + glm::vec3(triangle.c) * (s * t);
+}
+
+std::vector<glm::vec3> EmissionSurface::ExtractSurface(const float* density, glm::ivec3 dimensions)
+{
+	std::vector<glm::vec3> vertices;
+	auto at = [&](glm::ivec3 p) {
+		return density[((size_t)p.z * dimensions.y + p.y) * dimensions.x + p.x];
+	};
+
+	for (int z = 0; z < dimensions.z - 1; z++)
+	{
+		for (int y = 0; y < dimensions.y - 1; y++)
+		{
+			for (int x = 0; x < dimensions.x - 1; x++)
+			{
+				glm::ivec3 cell(x, y, z);
+				float corners[8];
+				unsigned int mcCase = 0;
+				for (int i = 0; i < 8; i++)
+				{
+					corners[i] = at(cell + CORNERS[i]);
+					if (corners[i] > 0.0f)
+						mcCase |= 1u << i;
+				}
+				if (mcCase == 0 || mcCase == 255)
+					continue;
+
+				for (int i = 0; i < 16 && triTable[mcCase * 16 + i] != (GLuint)-1; i++)
+				{
+					const int* edge = EDGE_CORNERS[triTable[mcCase * 16 + i]];
+					float d0 = corners[edge[0]], d1 = corners[edge[1]];
+					float t = d0 / (d0 - d1);
+					vertices.push_back(glm::vec3(cell) + glm::mix(glm::vec3(CORNERS[edge[0]]), glm::vec3(CORNERS[edge[1]]), t));
+				}
+			}
+		}
+	}
+	return vertices;
+}
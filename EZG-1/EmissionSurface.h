@@ -0,0 +1,62 @@
+#pragma once
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Triangle of an emission surface as stored on the GPU, w is unused
+struct SurfaceTriangle
+{
+	glm::vec4 a;
+	glm::vec4 b;
+	glm::vec4 c;
+};
+
+// Column of the alias table, the column's triangle is picked with the given probability, its alias otherwise
+struct AliasEntry
+{
+	float probability;
+	GLuint alias;
+};
+
+// Triangle mesh particles are spawned on, uniformly distributed over its area. An alias table over the
+// triangle areas picks a triangle with two random numbers and no search, so spawning costs the same on
+// any mesh size. The table is built on the CPU and uploaded for particleEmitCS, so only rebuild it when
+// the mesh changes.
+class EmissionSurface
+{
+public:
+	// Buffer bindings of the surface, next to the particle buffers
+	static const GLuint TRIANGLE_BINDING = 14;
+	static const GLuint ALIAS_TABLE_BINDING = 15;
+
+	EmissionSurface();
+	~EmissionSurface();
+
+	// Builds the alias table from a triangle list, three vertices per triangle. Degenerate triangles are never picked.
+	void Build(const std::vector<glm::vec3>& vertices);
+	// Binds the triangles and the alias table for the emit pass
+	void Bind() const;
+
+	// Uniformly distributed point on the surface, the key is hashed the same way as in Shaders/surfaceSampling.glsl
+	glm::vec3 Sample(uint32_t key) const;
+
+	unsigned int TriangleCount() const { return (unsigned int)mTriangles.size(); }
+	float Area() const { return mArea; }
+	// Incremented by every build
+	unsigned int Version() const { return mVersion; }
+
+	// Marching cubes triangles of the surface between solid and air of a density volume, in voxel coordinates.
+	// density is x major like glGetTexImage returns it, positive is solid.
+	static std::vector<glm::vec3> ExtractSurface(const float* density, glm::ivec3 dimensions);
+
+private:
+	std::vector<SurfaceTriangle> mTriangles;
+	std::vector<AliasEntry> mAliasTable;
+	float mArea = 0.0f;
+	unsigned int mVersion = 0;
+
+	GLuint mTriangleBuffer;
+	GLuint mAliasTableBuffer;
+};
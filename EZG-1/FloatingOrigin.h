@@ -0,0 +1,82 @@
+#pragma once
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <cmath>
+
+// A position in the tunnel, stored as the index of the sector it lies in plus a small local offset.
+// The local offset is relative to the start of that sector, so it never grows beyond one sector length.
+struct WorldPosition
+{
+	int Sector;
+	glm::vec3 Local;
+
+	WorldPosition(int sector = 0, glm::vec3 local = glm::vec3(0.0f)) : Sector(sector), Local(local) { }
+};
+
+// Keeps the rendering origin close to the camera. Everything that gets uploaded to a shader is expressed
+// relative to the origin sector, so float precision stays the same after hundreds of sectors.
+class FloatingOrigin
+{
+public:
+	// Sector the origin currently sits at
+	int Sector;
+	// Length of a sector along the tunnel (z) axis
+	float SectorLength;
+	// Local z bounds, leaving them moves the origin by one sector
+	float LowerBound;
+	float UpperBound;
+
+	FloatingOrigin(float sectorLength, float lowerBound, float upperBound) : Sector(0), SectorLength(sectorLength), LowerBound(lowerBound), UpperBound(upperBound) { }
+
+	// Moves the origin when the local position has left the bounds and shifts the position back
+	// into the new origin sector. Returns true if the origin changed.
+	bool Rebase(glm::vec3& local)
+	{
+		bool changed = false;
+		while (local.z < LowerBound)
+		{
+			Sector--;
+			local.z += SectorLength;
+			changed = true;
+		}
+		while (local.z > UpperBound)
+		{
+			Sector++;
+			local.z -= SectorLength;
+			changed = true;
+		}
+		return changed;
+	}
+
+	// Converts a world position into origin relative coordinates. The integer sector difference is
+	// resolved first, so the float part only ever holds a few sectors worth of distance.
+	glm::vec3 ToLocal(const WorldPosition& position) const
+	{
+		return position.Local + glm::vec3(0.0f, 0.0f, float(position.Sector - Sector) * SectorLength);
+	}
+
+	// Converts origin relative coordinates back into a world position
+	WorldPosition ToWorld(glm::vec3 local) const
+	{
+		WorldPosition position(Sector, local);
+		int offset = int(std::floor(local.z / SectorLength));
+		position.Sector += offset;
+		position.Local.z -= float(offset) * SectorLength;
+		return position;
+	}
+
+	// Model matrix that places geometry built in the local space of the given sector
+	glm::mat4 SectorTransform(int sector) const
+	{
+		return glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, float(sector - Sector) * SectorLength));
+	}
+
+	// Fractional offset of the origin in texture space, for world space texture projections that should
+	// not jump when the origin moves. Computed in double so it stays exact for far away sectors.
+	float TextureOffset(float textureScale) const
+	{
+		double offset = double(Sector) * double(SectorLength) * double(textureScale);
+		return float(offset - std::floor(offset));
+	}
+};
@@ -0,0 +1,117 @@
+#include "ForceField.h"
+#include "ParticleRandom.h"
+
+#include <algorithm>
+#include <cmath>
+
+ForceField::ForceField(unsigned int size, unsigned int period, unsigned int seed) : mSize(size), mPeriod(period), mSeed(seed)
+{
+	bake();
+
+	glGenTextures(1, &mTexture);
+	glBindTexture(GL_TEXTURE_3D, mTexture);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_REPEAT);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB16F, mSize, mSize, mSize, 0, GL_RGB, GL_FLOAT, mVelocities.data());
+	glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+ForceField::~ForceField()
+{
+	glDeleteTextures(1, &mTexture);
+}
+
+glm::vec3 ForceField::gradient(glm::ivec3 cell, unsigned int channel) const
+{
+	// wrapping the lattice makes the noise repeat every mPeriod cells
+	int period = (int)mPeriod;
+	glm::uvec3 c = glm::uvec3(((cell % period) + period) % period);
+	uint32_t key = PcgHash(c.x ^ PcgHash(c.y ^ PcgHash(c.z ^ PcgHash(mSeed * 3 + channel))));
+	return RandomVec3(key) * 2.0f - 1.0f;
+}
+
+float ForceField::noise(glm::vec3 position, unsigned int channel) const
+{
+	glm::vec3 floor = glm::floor(position);
+	glm::ivec3 cell = glm::ivec3(floor);
+	glm::vec3 f = position - floor;
+	glm::vec3 u = f * f * f * (f * (f * 6.0f - 15.0f) + 10.0f);
+
+	float corners[8];
+	for (int i = 0; i < 8; i++)
+	{
+		glm::ivec3 corner(i & 1, (i >> 1) & 1, i >> 2);
+		corners[i] = glm::dot(gradient(cell + corner, channel), f - glm::vec3(corner));
+	}
+	float x00 = glm::mix(corners[0], corners[1], u.x);
+	float x10 = glm::mix(corners[2], corners[3], u.x);
+	float x01 = glm::mix(corners[4], corners[5], u.x);
+	float x11 = glm::mix(corners[6], corners[7], u.x);
+	return glm::mix(glm::mix(x00, x10, u.y), glm::mix(x01, x11, u.y), u.z);
+}
+
+glm::vec3 ForceField::potential(glm::vec3 position) const
+{
+	return glm::vec3(noise(position, 0), noise(position, 1), noise(position, 2));
+}
+
+void ForceField::bake()
+{
+	mVelocities.resize((size_t)mSize * mSize * mSize);
+
+	// central differences of the potential in noise cells
+	const float h = 0.01f;
+	float longest = 0.0f;
+	for (unsigned int z = 0; z < mSize; z++)
+	{
+		for (unsigned int y = 0; y < mSize; y++)
+		{
+			for (unsigned int x = 0; x < mSize; x++)
+			{
+				// texel centers, the same positions the texture is sampled at
+				glm::vec3 p = (glm::vec3(x, y, z) + 0.5f) / (float)mSize * (float)mPeriod;
+				glm::vec3 dx = (potential(p + glm::vec3(h, 0, 0)) - potential(p - glm::vec3(h, 0, 0))) / (2.0f * h);
+				glm::vec3 dy = (potential(p + glm::vec3(0, h, 0)) - potential(p - glm::vec3(0, h, 0))) / (2.0f * h);
+				glm::vec3 dz = (potential(p + glm::vec3(0, 0, h)) - potential(p - glm::vec3(0, 0, h))) / (2.0f * h);
+				glm::vec3 curl(dy.z - dz.y, dz.x - dx.z, dx.y - dy.x);
+				mVelocities[((size_t)z * mSize + y) * mSize + x] = curl;
+				longest = std::max(longest, glm::length(curl));
+			}
+		}
+	}
+
+	// scaled so Strength is the largest acceleration independent of the noise settings
+	if (longest > 0.0f)
+	{
+		for (glm::vec3& velocity : mVelocities)
+			velocity /= longest;
+	}
+}
+
+const glm::vec3& ForceField::at(int x, int y, int z) const
+{
+	int size = (int)mSize;
+	x = ((x % size) + size) % size;
+	y = ((y % size) + size) % size;
+	z = ((z % size) + size) % size;
+	return mVelocities[((size_t)z * mSize + y) * mSize + x];
+}
+
+glm::vec3 ForceField::Sample(glm::vec3 position) const
+{
+	// texel centers sit at half texel offsets like in GL
+	glm::vec3 p = position * (float)mSize - 0.5f;
+	glm::vec3 floor = glm::floor(p);
+	glm::ivec3 p0 = glm::ivec3(floor);
+	glm::vec3 t = p - floor;
+
+	glm::vec3 c00 = glm::mix(at(p0.x, p0.y, p0.z), at(p0.x + 1, p0.y, p0.z), t.x);
+	glm::vec3 c10 = glm::mix(at(p0.x, p0.y + 1, p0.z), at(p0.x + 1, p0.y + 1, p0.z), t.x);
+	glm::vec3 c01 = glm::mix(at(p0.x, p0.y, p0.z + 1), at(p0.x + 1, p0.y, p0.z + 1), t.x);
+	glm::vec3 c11 = glm::mix(at(p0.x, p0.y + 1, p0.z + 1), at(p0.x + 1, p0.y + 1, p0.z + 1), t.x);
+	return glm::mix(glm::mix(c00, c10, t.y), glm::mix(c01, c11, t.y), t.z);
+}
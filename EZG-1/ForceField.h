@@ -0,0 +1,54 @@
+#pragma once
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+#include <vector>
+
+// Settings of the curl noise force field, shared by the CPU and GPU paths
+struct ParticleForceField
+{
+	bool Enabled = false;
+	// acceleration at the strongest point of the field
+	float Strength = 25.0f;
+	// world units covered by one repetition of the volume
+	float TileSize = 16.0f;
+	// world units per second the field moves by, animates the flow without baking again
+	glm::vec3 Scroll = glm::vec3(1.5f, 0.5f, 1.0f);
+};
+
+// Tileable curl noise velocity volume. The curl of a noise vector potential is divergence free,
+// so particles swirl around without bunching up in sinks. Baked once on the CPU from periodic
+// gradient noise and uploaded as a repeating, linearly filtered 3D texture, so the update costs
+// one trilinear fetch per particle instead of evaluating noise.
+class ForceField
+{
+public:
+	// size texels per edge, period noise cells per tile
+	ForceField(unsigned int size = 32, unsigned int period = 4, unsigned int seed = 0);
+	~ForceField();
+
+	// Trilinear sample with wrap around, the same as the texture lookup. Positions are in tiles.
+	glm::vec3 Sample(glm::vec3 position) const;
+	// Acceleration at a world position, time is the seconds the field has been scrolling
+	glm::vec3 Force(glm::vec3 position, const ParticleForceField& settings, float time) const
+	{
+		return Sample((position - settings.Scroll * time) / settings.TileSize) * settings.Strength;
+	}
+
+	// RGB16F 3D texture with GL_REPEAT and GL_LINEAR, the longest vector has length 1
+	GLuint Texture() const { return mTexture; }
+	unsigned int Size() const { return mSize; }
+
+private:
+	unsigned int mSize;
+	unsigned int mPeriod;
+	unsigned int mSeed;
+	std::vector<glm::vec3> mVelocities;
+	GLuint mTexture = 0;
+
+	void bake();
+	glm::vec3 gradient(glm::ivec3 cell, unsigned int channel) const;
+	float noise(glm::vec3 position, unsigned int channel) const;
+	glm::vec3 potential(glm::vec3 position) const;
+	const glm::vec3& at(int x, int y, int z) const;
+};
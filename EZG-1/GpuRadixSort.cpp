@@ -0,0 +1,158 @@
+#include "GpuRadixSort.h"
+
+#include "RadixSort.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+// Buffer bindings, same as in the radix sort shaders
+enum SortBinding {
+	KEYS_IN_BINDING = 0,
+	VALUES_IN_BINDING = 1,
+	KEYS_OUT_BINDING = 2,
+	VALUES_OUT_BINDING = 3,
+	HISTOGRAM_BINDING = 4
+};
+
+static const unsigned int RADIX = 256;
+
+GpuRadixSort::GpuRadixSort(unsigned int capacity) : mCapacity(capacity)
+{
+	unsigned int groups = (capacity + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+	glGenBuffers(1, &mKeyBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mKeyBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * capacity, nullptr, GL_DYNAMIC_COPY);
+
+	glGenBuffers(1, &mValueBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mValueBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * capacity, nullptr, GL_DYNAMIC_COPY);
+
+	glGenBuffers(1, &mHistogramBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mHistogramBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * RADIX * groups, nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	LoadShaders();
+}
+
+GpuRadixSort::~GpuRadixSort()
+{
+	glDeleteBuffers(1, &mKeyBuffer);
+	glDeleteBuffers(1, &mValueBuffer);
+	glDeleteBuffers(1, &mHistogramBuffer);
+	delete mHistogramShader;
+	delete mScanShader;
+	delete mScatterShader;
+}
+
+void GpuRadixSort::LoadShaders()
+{
+	delete mHistogramShader;
+	delete mScanShader;
+	delete mScatterShader;
+
+	mHistogramShader = new Shader("Shaders/radixHistogramCS.glsl");
+	mScanShader = new Shader("Shaders/radixScanCS.glsl");
+	mScatterShader = new Shader("Shaders/radixScatterCS.glsl");
+}
+
+void GpuRadixSort::Sort(GLuint keyBuffer, GLuint valueBuffer, unsigned int count)
+{
+	if (count > mCapacity)
+	{
+		std::cout << "ERROR::RADIX_SORT::COUNT_EXCEEDS_CAPACITY " << count << " > " << mCapacity << std::endl;
+		count = mCapacity;
+	}
+	if (count < 2)
+		return;
+
+	unsigned int groups = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	GLuint keys[2] = { keyBuffer, mKeyBuffer };
+	GLuint values[2] = { valueBuffer, mValueBuffer };
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, HISTOGRAM_BINDING, mHistogramBuffer);
+	for (int pass = 0; pass < 4; pass++)
+	{
+		int in = pass & 1;
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, KEYS_IN_BINDING, keys[in]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VALUES_IN_BINDING, values[in]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, KEYS_OUT_BINDING, keys[1 - in]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VALUES_OUT_BINDING, values[1 - in]);
+
+		mHistogramShader->use();
+		mHistogramShader->setInt("count", count);
+		mHistogramShader->setInt("shift", pass * 8);
+		glDispatchCompute(groups, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		mScanShader->use();
+		mScanShader->setInt("size", RADIX * groups);
+		glDispatchCompute(1, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		mScatterShader->use();
+		mScatterShader->setInt("count", count);
+		mScatterShader->setInt("shift", pass * 8);
+		glDispatchCompute(groups, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+}
+
+void GpuRadixSort::Benchmark(const std::vector<unsigned int>& counts, unsigned int repetitions)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> distribution(0.0f, 100.0f);
+
+	GLuint query;
+	glGenQueries(1, &query);
+
+	std::cout << "GPU radix sort benchmark, " << repetitions << " repetitions" << std::endl;
+	for (unsigned int count : counts)
+	{
+		std::vector<GLuint> keys(count), values(count);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			keys[i] = SortableKey(distribution(random));
+			values[i] = i;
+		}
+
+		GLuint buffers[2];
+		glGenBuffers(2, buffers);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[0]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * count, nullptr, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[1]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * count, nullptr, GL_DYNAMIC_COPY);
+
+		GpuRadixSort sort(count);
+		GLuint64 totalNanoseconds = 0;
+		for (unsigned int repetition = 0; repetition < repetitions; repetition++)
+		{
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[0]);
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint) * count, keys.data());
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[1]);
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint) * count, values.data());
+
+			glBeginQuery(GL_TIME_ELAPSED, query);
+			sort.Sort(buffers[0], buffers[1], count);
+			glEndQuery(GL_TIME_ELAPSED);
+
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+			totalNanoseconds += nanoseconds;
+		}
+
+		std::vector<GLuint> sorted(count);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[0]);
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint) * count, sorted.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		glDeleteBuffers(2, buffers);
+
+		double milliseconds = double(totalNanoseconds) / 1000000.0 / repetitions;
+		std::cout << count << " keys: " << milliseconds << " ms/sort, " << (milliseconds * 1000000.0 / count) << " ms per million keys"
+			<< (std::is_sorted(sorted.begin(), sorted.end()) ? "" : ", NOT SORTED") << std::endl;
+	}
+
+	glDeleteQueries(1, &query);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "glad/glad.h"
+
+#include "Shader.h"
+
+#include <vector>
+
+// Compute shader LSD radix sort of 32 bit keys with 32 bit values in shader storage buffers.
+// Every 8 bit pass builds per work group digit histograms, scans them in one work group and scatters
+// blocks that were sorted stably in shared memory. Four passes leave the result in the input buffers.
+class GpuRadixSort
+{
+public:
+	// keys per sort work group
+	static const unsigned int BLOCK_SIZE = 1024;
+
+	GpuRadixSort(unsigned int capacity);
+	~GpuRadixSort();
+
+	// (Re)loads the sort shaders, called on shader hot reloading
+	void LoadShaders();
+
+	// Sorts the first count keys ascending and moves the values along, count must not exceed the capacity
+	void Sort(GLuint keyBuffer, GLuint valueBuffer, unsigned int count);
+
+	unsigned int Capacity() const { return mCapacity; }
+
+	// Prints GPU sort times for the given counts of random keys, waits for the GPU
+	static void Benchmark(const std::vector<unsigned int>& counts, unsigned int repetitions);
+
+private:
+	unsigned int mCapacity;
+	GLuint mKeyBuffer;
+	GLuint mValueBuffer;
+	GLuint mHistogramBuffer;
+
+	Shader* mHistogramShader = nullptr;
+	Shader* mScanShader = nullptr;
+	Shader* mScatterShader = nullptr;
+};
@@ -0,0 +1,114 @@
+#include "GpuSpatialHash.h"
+
+// Slot counts a work group of gridScanCS.glsl scans, 1024 invocations with 4 each
+static const unsigned int GRID_SCAN_BLOCK_SIZE = 4096;
+
+GpuSpatialHash::GpuSpatialHash(unsigned int capacity, unsigned int tableSize)
+{
+	unsigned int size = 1;
+	while (size < tableSize)
+		size <<= 1;
+	mTableMask = size - 1;
+
+	// one extra start ends the last slot
+	glGenBuffers(1, &mCellStartBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCellStartBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * (size + 1), nullptr, GL_DYNAMIC_COPY);
+
+	// xyz position, w slot
+	glGenBuffers(1, &mEntryBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mEntryBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLfloat) * 4 * capacity, nullptr, GL_DYNAMIC_COPY);
+
+	// hash slot and offset inside the slot of every alive particle
+	glGenBuffers(1, &mParticleCellBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mParticleCellBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * 2 * capacity, nullptr, GL_DYNAMIC_COPY);
+
+	glGenBuffers(1, &mBlockSumBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mBlockSumBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * scanBlocks(), nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	LoadShaders();
+}
+
+GpuSpatialHash::~GpuSpatialHash()
+{
+	glDeleteBuffers(1, &mCellStartBuffer);
+	glDeleteBuffers(1, &mEntryBuffer);
+	glDeleteBuffers(1, &mParticleCellBuffer);
+	glDeleteBuffers(1, &mBlockSumBuffer);
+	delete mCountShader;
+	delete mBlockScanShader;
+	delete mScanShader;
+	delete mScatterShader;
+}
+
+void GpuSpatialHash::LoadShaders()
+{
+	delete mCountShader;
+	delete mBlockScanShader;
+	delete mScanShader;
+	delete mScatterShader;
+
+	mCountShader = new Shader("Shaders/gridCountCS.glsl");
+	mBlockScanShader = new Shader("Shaders/gridScanCS.glsl");
+	// the exclusive scan of the radix sort works on any uint buffer at binding 4, here the block totals
+	mScanShader = new Shader("Shaders/radixScanCS.glsl");
+	mScatterShader = new Shader("Shaders/gridScatterCS.glsl");
+}
+
+void GpuSpatialHash::Build(GLuint counterBuffer, GLintptr simulateGroupsOffset, float cellSize, glm::vec3 origin)
+{
+	GLuint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCellStartBuffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CELL_START_BINDING, mCellStartBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ENTRY_BINDING, mEntryBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLE_CELL_BINDING, mParticleCellBuffer);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// 1. count per hash slot, one invocation per alive particle
+	mCountShader->use();
+	mCountShader->setFloat("cellSize", cellSize);
+	mCountShader->setInt("tableMask", mTableMask);
+	mCountShader->setVec3("origin", origin);
+	glDispatchComputeIndirect(simulateGroupsOffset);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// 2. counts to slot starts, every block on its own, then the block totals, then the totals onto the blocks
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, mBlockSumBuffer);
+	mBlockScanShader->use();
+	mBlockScanShader->setInt("size", scanSize());
+	mBlockScanShader->setBool("addBlockSums", false);
+	glDispatchCompute(scanBlocks(), 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	mScanShader->use();
+	mScanShader->setInt("size", scanBlocks());
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	mBlockScanShader->use();
+	mBlockScanShader->setBool("addBlockSums", true);
+	glDispatchCompute(scanBlocks(), 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, counterBuffer);
+
+	// 3. positions and slots into cell order
+	mScatterShader->use();
+	mScatterShader->setVec3("origin", origin);
+	glDispatchComputeIndirect(simulateGroupsOffset);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+unsigned int GpuSpatialHash::scanBlocks() const
+{
+	return (scanSize() + GRID_SCAN_BLOCK_SIZE - 1) / GRID_SCAN_BLOCK_SIZE;
+}
+
+void GpuSpatialHash::Bind()
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CELL_START_BINDING, mCellStartBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ENTRY_BINDING, mEntryBuffer);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "glad/glad.h"
+
+#include "Shader.h"
+#include "SpatialHash.h"
+
+// Compute shader version of SpatialHash for the particles of ComputeParticleSystem. The build counts the alive
+// particles per hash slot with atomics, scans the counts and scatters position and slot into cell order.
+// The scan runs over blocks of the table in parallel, only the block totals are scanned by a single work group.
+class GpuSpatialHash
+{
+public:
+	// Buffer bindings of the grid, the particle buffers keep theirs
+	static const GLuint CELL_START_BINDING = 9;
+	static const GLuint ENTRY_BINDING = 10;
+	static const GLuint PARTICLE_CELL_BINDING = 11;
+
+	// tableSize is rounded up to a power of two
+	GpuSpatialHash(unsigned int capacity, unsigned int tableSize = 1 << 18);
+	~GpuSpatialHash();
+
+	// (Re)loads the grid shaders, called on shader hot reloading
+	void LoadShaders();
+
+	// Expects the particle, alive list and counter buffers bound at 0, 2 and 4, and the indirect buffer of
+	// the simulate dispatch bound. The scan borrows binding 4, counterBuffer is bound back afterwards.
+	// origin is the one the particle positions are packed relative to.
+	void Build(GLuint counterBuffer, GLintptr simulateGroupsOffset, float cellSize, glm::vec3 origin);
+	// Binds the built grid for the simulate pass
+	void Bind();
+
+	unsigned int TableSize() const { return mTableMask + 1; }
+	unsigned int TableMask() const { return mTableMask; }
+
+private:
+	unsigned int mTableMask;
+	GLuint mCellStartBuffer;
+	GLuint mEntryBuffer;
+	GLuint mParticleCellBuffer;
+	// one total per scan block
+	GLuint mBlockSumBuffer;
+
+	Shader* mCountShader = nullptr;
+	Shader* mBlockScanShader = nullptr;
+	Shader* mScanShader = nullptr;
+	Shader* mScatterShader = nullptr;
+
+	// slot starts to scan, the table plus the one start that ends the last slot
+	unsigned int scanSize() const { return mTableMask + 2; }
+	unsigned int scanBlocks() const;
+};
@@ -0,0 +1,58 @@
+#include "GpuTimer.h"
+
+GpuTimer::GpuTimer()
+{
+	glGenQueries(RING_SIZE, mQueries);
+	for (unsigned int i = 0; i < RING_SIZE; i++)
+		mPending[i] = false;
+}
+
+GpuTimer::~GpuTimer()
+{
+	glDeleteQueries(RING_SIZE, mQueries);
+}
+
+void GpuTimer::collect()
+{
+	// read every finished query, oldest first
+	for (unsigned int n = 1; n <= RING_SIZE; n++)
+	{
+		unsigned int i = (mCurrent + n) % RING_SIZE;
+		if (!mPending[i])
+			continue;
+
+		GLint available = 0;
+		glGetQueryObjectiv(mQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			continue;
+
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(mQueries[i], GL_QUERY_RESULT, &nanoseconds);
+		mPending[i] = false;
+		mMilliseconds = double(nanoseconds) / 1000000.0;
+		mTotalMilliseconds += mMilliseconds;
+		mSamples++;
+	}
+}
+
+void GpuTimer::Begin()
+{
+	collect();
+	mCurrent = (mCurrent + 1) % RING_SIZE;
+	// the ring is full, skip the oldest result instead of waiting for it
+	if (mPending[mCurrent])
+		mPending[mCurrent] = false;
+	glBeginQuery(GL_TIME_ELAPSED, mQueries[mCurrent]);
+}
+
+void GpuTimer::End()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	mPending[mCurrent] = true;
+}
+
+void GpuTimer::Reset()
+{
+	mTotalMilliseconds = 0.0;
+	mSamples = 0;
+}
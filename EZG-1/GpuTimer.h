@@ -0,0 +1,33 @@
+#pragma once
+#include "glad/glad.h"
+
+// Measures GPU time with GL_TIME_ELAPSED queries. Queries rotate through a small ring and results are only
+// read once they are available, so measuring never stalls the pipeline. Results lag a few frames behind.
+class GpuTimer
+{
+public:
+	static const unsigned int RING_SIZE = 4;
+
+	GpuTimer();
+	~GpuTimer();
+
+	void Begin();
+	void End();
+
+	// Latest available result in milliseconds
+	double Milliseconds() const { return mMilliseconds; }
+	// Average over all results since the last Reset
+	double AverageMilliseconds() const { return mSamples > 0 ? mTotalMilliseconds / mSamples : 0.0; }
+	unsigned int Samples() const { return mSamples; }
+	void Reset();
+
+private:
+	GLuint mQueries[RING_SIZE];
+	bool mPending[RING_SIZE];
+	unsigned int mCurrent = 0;
+	double mMilliseconds = 0.0;
+	double mTotalMilliseconds = 0.0;
+	unsigned int mSamples = 0;
+
+	void collect();
+};
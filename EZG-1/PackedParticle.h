@@ -0,0 +1,53 @@
+#pragma once
+#include "glm/glm.hpp"
+#include "glm/gtc/packing.hpp"
+
+#include "Particles.h"
+
+#include <cmath>
+#include <cstdint>
+
+// 16 byte particle state of the compute pipeline, the same packing as Shaders/particlePacking.glsl.
+// Position and velocity are half floats, the position relative to an origin near the camera so the precision
+// is best where particles are seen. Lifetime is 16 bit normalised over PACKED_MAX_LIFETIME, type and flags a byte each.
+// Half floats are 0.03 units apart at 32 to 64 units from the origin and twice that per further doubling. The
+// simulate pass rounds repacked positions up or down at random so slow particles still move on average, they
+// jitter by up to that spacing. Unmoved positions repack exactly while the origin stays, an origin that moves
+// further away rounds them once to the coarser spacing.
+//   x: position.x, position.y   y: position.z, velocity.x   z: velocity.y, velocity.z   w: lifeTime | type << 16 | flags << 24
+struct PackedParticle
+{
+	uint32_t data[4];
+};
+
+// Lifetimes are clamped to this, longer than any particle or emitter lives
+const float PACKED_MAX_LIFETIME = 16.0f;
+
+inline PackedParticle PackParticle(const particlestruct& particle, glm::vec3 origin, unsigned int flags = 0)
+{
+	glm::vec3 position = particle.position - origin;
+	float lifeTime = glm::clamp(particle.lifeTime / PACKED_MAX_LIFETIME, 0.0f, 1.0f);
+
+	PackedParticle packed;
+	packed.data[0] = glm::packHalf2x16(glm::vec2(position.x, position.y));
+	packed.data[1] = glm::packHalf2x16(glm::vec2(position.z, particle.velocity.x));
+	packed.data[2] = glm::packHalf2x16(glm::vec2(particle.velocity.y, particle.velocity.z));
+	packed.data[3] = uint32_t(std::floor(lifeTime * 65535.0f + 0.5f)) | (uint32_t(particle.type) & 0xFFu) << 16 | (flags & 0xFFu) << 24;
+	return packed;
+}
+
+inline particlestruct UnpackParticle(const PackedParticle& packed, glm::vec3 origin, unsigned int* flags = nullptr)
+{
+	glm::vec2 xy = glm::unpackHalf2x16(packed.data[0]);
+	glm::vec2 zw = glm::unpackHalf2x16(packed.data[1]);
+	glm::vec2 yz = glm::unpackHalf2x16(packed.data[2]);
+
+	particlestruct particle;
+	particle.position = glm::vec3(xy.x, xy.y, zw.x) + origin;
+	particle.velocity = glm::vec3(zw.y, yz.x, yz.y);
+	particle.lifeTime = float(packed.data[3] & 0xFFFFu) / 65535.0f * PACKED_MAX_LIFETIME;
+	particle.type = float((packed.data[3] >> 16) & 0xFFu);
+	if (flags != nullptr)
+		*flags = packed.data[3] >> 24;
+	return particle;
+}
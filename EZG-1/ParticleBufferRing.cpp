@@ -0,0 +1,200 @@
+#include "ParticleBufferRing.h"
+
+#include <algorithm>
+#include <chrono>
+
+ParticleBufferRing::ParticleBufferRing(unsigned int capacity, unsigned int depth, const particlestruct* particles, unsigned int count)
+	: mCapacity(capacity), mDepth(depth < 2 ? 2 : depth)
+{
+	mBuffers.resize(mDepth);
+	mVertexArrays.resize(mDepth);
+	mFeedbacks.resize(mDepth);
+	mIndexBuffers.resize(mDepth);
+	mFences.assign(mDepth, nullptr);
+	glGenBuffers(mDepth, mBuffers.data());
+	glGenBuffers(mDepth, mIndexBuffers.data());
+	glGenVertexArrays(mDepth, mVertexArrays.data());
+	glGenTransformFeedbacks(mDepth, mFeedbacks.data());
+
+	for (unsigned int i = 0; i < mDepth; i++)
+	{
+		glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, mFeedbacks[i]);
+		glBindBuffer(GL_ARRAY_BUFFER, mBuffers[i]);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(particlestruct) * mCapacity, nullptr, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(particlestruct) * count, particles);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, mBuffers[i]);
+
+		glBindVertexArray(mVertexArrays[i]);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(particlestruct), 0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(particlestruct), (void*)(sizeof(float) * 3));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(particlestruct), (void*)(sizeof(float) * 6));
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(particlestruct), (void*)(sizeof(float) * 7));
+		// part of the vertex array state
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffers[i]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * mCapacity, nullptr, GL_DYNAMIC_DRAW);
+	}
+	glBindVertexArray(0);
+	glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+
+	mReadbackBuffers.resize(mDepth);
+	mReadbackFences.assign(mDepth, nullptr);
+	mReadbackCounts.assign(mDepth, 0);
+	mReadbackFrames.assign(mDepth, 0);
+	mMapped.assign(mDepth, nullptr);
+	glGenBuffers(mDepth, mReadbackBuffers.data());
+	for (unsigned int i = 0; i < mDepth; i++)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mReadbackBuffers[i]);
+		if (GLAD_GL_VERSION_4_4)
+		{
+			// coherent, so a copy is visible to the CPU as soon as its fence has passed
+			GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_COPY_WRITE_BUFFER, sizeof(particlestruct) * mCapacity, nullptr, flags);
+			mMapped[i] = (particlestruct*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, sizeof(particlestruct) * mCapacity, flags);
+		}
+		else
+			glBufferData(GL_COPY_WRITE_BUFFER, sizeof(particlestruct) * mCapacity, nullptr, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+ParticleBufferRing::~ParticleBufferRing()
+{
+	for (unsigned int i = 0; i < mDepth; i++)
+	{
+		if (mFences[i] != nullptr)
+			glDeleteSync(mFences[i]);
+		if (mReadbackFences[i] != nullptr)
+			glDeleteSync(mReadbackFences[i]);
+		if (mMapped[i] != nullptr)
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, mReadbackBuffers[i]);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		}
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glDeleteBuffers(mDepth, mReadbackBuffers.data());
+	glDeleteTransformFeedbacks(mDepth, mFeedbacks.data());
+	glDeleteVertexArrays(mDepth, mVertexArrays.data());
+	glDeleteBuffers(mDepth, mIndexBuffers.data());
+	glDeleteBuffers(mDepth, mBuffers.data());
+}
+
+bool ParticleBufferRing::signaled(GLsync fence)
+{
+	GLint status = GL_UNSIGNALED;
+	glGetSynciv(fence, GL_SYNC_STATUS, sizeof(status), nullptr, &status);
+	return status == GL_SIGNALED;
+}
+
+bool ParticleBufferRing::waitFor(GLsync& fence)
+{
+	if (fence == nullptr)
+		return false;
+
+	bool stalled = false;
+	if (!signaled(fence))
+	{
+		stalled = true;
+		auto start = std::chrono::high_resolution_clock::now();
+		// the flush makes sure the fence gets to the GPU, otherwise the wait could last forever
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while (glClientWaitSync(fence, flags, 1000000) == GL_TIMEOUT_EXPIRED)
+			flags = 0;
+		mStallMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+	glDeleteSync(fence);
+	fence = nullptr;
+	return stalled;
+}
+
+void ParticleBufferRing::AcquireTarget()
+{
+	if (waitFor(mFences[target()]))
+		mStalls++;
+}
+
+void ParticleBufferRing::Restart(const particlestruct* particles, unsigned int count)
+{
+	for (unsigned int i = 0; i < mDepth; i++)
+	{
+		waitFor(mFences[i]);
+		if (mReadbackFences[i] != nullptr)
+		{
+			glDeleteSync(mReadbackFences[i]);
+			mReadbackFences[i] = nullptr;
+		}
+	}
+
+	mSource = 0;
+	glBindBuffer(GL_ARRAY_BUFFER, mBuffers[mSource]);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(particlestruct) * std::min(count, mCapacity), particles);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ParticleBufferRing::Advance(unsigned int count)
+{
+	unsigned int drawn = target();
+	if (mFences[drawn] != nullptr)
+		glDeleteSync(mFences[drawn]);
+	mFences[drawn] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	if (ReadbackEnabled)
+	{
+		// the slot was last copied depth frames ago, its old copy is dropped whether it was read or not
+		unsigned int slot = mFrame % mDepth;
+		if (mReadbackFences[slot] != nullptr)
+		{
+			glDeleteSync(mReadbackFences[slot]);
+			mReadbackFences[slot] = nullptr;
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, mBuffers[drawn]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mReadbackBuffers[slot]);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(particlestruct) * count);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		mReadbackFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		mReadbackCounts[slot] = count;
+		mReadbackFrames[slot] = mFrame;
+	}
+
+	mFrame++;
+	mSource = drawn;
+}
+
+const particlestruct* ParticleBufferRing::Readback(unsigned int& count, unsigned int& age)
+{
+	// newest first, the copies of the last frames are most likely still in flight
+	for (unsigned int n = 1; n <= mDepth && n <= mFrame; n++)
+	{
+		unsigned int slot = (mFrame - n) % mDepth;
+		if (mReadbackFences[slot] == nullptr || mReadbackFrames[slot] != mFrame - n || !signaled(mReadbackFences[slot]))
+			continue;
+
+		count = mReadbackCounts[slot];
+		age = n;
+		if (mMapped[slot] != nullptr)
+			return mMapped[slot];
+
+		// the copy is done, so reading it back does not wait
+		mReadbackCopy.resize(count);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mReadbackBuffers[slot]);
+		glGetBufferSubData(GL_COPY_WRITE_BUFFER, 0, sizeof(particlestruct) * count, mReadbackCopy.data());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return mReadbackCopy.data();
+	}
+	count = 0;
+	age = 0;
+	return nullptr;
+}
+
+void ParticleBufferRing::Reset()
+{
+	mStalls = 0;
+	mStallMilliseconds = 0.0;
+}
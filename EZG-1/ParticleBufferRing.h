@@ -0,0 +1,84 @@
+#pragma once
+#include "glad/glad.h"
+
+#include "Particles.h"
+
+#include <vector>
+
+// Ring of particle buffers for the transform feedback and CPU uploaded particles. Every update reads the
+// state of the last one from the source buffer and writes into the target, rendering draws the target and
+// Advance moves on by one. With a depth of N the target was last drawn N - 1 frames ago, a fence set after
+// that draw tells whether the GPU is done with it. AcquireTarget waits on the fence before the CPU writes
+// into the target, the waits that were not already over are counted as stalls. Every buffer has an index
+// buffer for the draw order next to it, bound as element buffer of its vertex array and fenced along with it.
+// With readback on, every frame copies the particles into a readback ring as well, which the CPU can query
+// once the copy's fence has passed. The readback buffers are persistently mapped where the context
+// supports buffer storage (4.4), otherwise the finished copy is read with glGetBufferSubData.
+class ParticleBufferRing
+{
+public:
+	// Vertex layout of particlestruct in every vertex array, filled with count initial particles
+	ParticleBufferRing(unsigned int capacity, unsigned int depth, const particlestruct* particles, unsigned int count);
+	~ParticleBufferRing();
+
+	unsigned int Depth() const { return mDepth; }
+
+	// State of the last update, read by the transform feedback pass
+	GLuint SourceBuffer() const { return mBuffers[mSource]; }
+	GLuint SourceVertexArray() const { return mVertexArrays[mSource]; }
+	GLuint SourceFeedback() const { return mFeedbacks[mSource]; }
+	// Written by the current update and drawn after it
+	GLuint TargetBuffer() const { return mBuffers[target()]; }
+	GLuint TargetVertexArray() const { return mVertexArrays[target()]; }
+	GLuint TargetFeedback() const { return mFeedbacks[target()]; }
+	// Draw order of the target, capacity indices
+	GLuint TargetIndexBuffer() const { return mIndexBuffers[target()]; }
+
+	// Waits until the GPU no longer reads the target, call before writing into it from the CPU
+	void AcquireTarget();
+	// Starts over from count particles in the source, when the particles were reset or another mode wrote
+	// the buffers. Waits for every buffer and drops the readback copies.
+	void Restart(const particlestruct* particles, unsigned int count);
+	// Call after the target was drawn, fences it and makes it the source of the next update.
+	// With readback on, count particles of the target are copied for the CPU first.
+	void Advance(unsigned int count);
+
+	// Copies the particles for Readback every frame, off by default
+	bool ReadbackEnabled = false;
+	bool PersistentlyMapped() const { return mMapped[0] != nullptr; }
+	// Newest copy the GPU has finished without waiting for it, nullptr if there is none yet.
+	// count and age in frames of the copy are returned as well. Valid until the next Advance.
+	const particlestruct* Readback(unsigned int& count, unsigned int& age);
+
+	// Acquires since the last Reset that had to wait for the GPU and the time spent waiting
+	unsigned int Stalls() const { return mStalls; }
+	double StallMilliseconds() const { return mStallMilliseconds; }
+	void Reset();
+
+private:
+	unsigned int mCapacity;
+	unsigned int mDepth;
+	unsigned int mSource = 0;
+	std::vector<GLuint> mBuffers;
+	std::vector<GLuint> mVertexArrays;
+	std::vector<GLuint> mFeedbacks;
+	std::vector<GLuint> mIndexBuffers;
+	std::vector<GLsync> mFences;
+
+	// readback ring, one copy per frame
+	unsigned int mFrame = 0;
+	std::vector<GLuint> mReadbackBuffers;
+	std::vector<GLsync> mReadbackFences;
+	std::vector<unsigned int> mReadbackCounts;
+	std::vector<unsigned int> mReadbackFrames;
+	std::vector<particlestruct*> mMapped;
+	std::vector<particlestruct> mReadbackCopy;
+
+	unsigned int mStalls = 0;
+	double mStallMilliseconds = 0.0;
+
+	unsigned int target() const { return (mSource + 1) % mDepth; }
+	// Waits for fence and deletes it, returns false if it had already passed
+	bool waitFor(GLsync& fence);
+	static bool signaled(GLsync fence);
+};
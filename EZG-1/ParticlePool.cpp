@@ -0,0 +1,197 @@
+#include "ParticlePool.h"
+
+#include <algorithm>
+
+// Slots per update task
+static const unsigned int CHUNK_SIZE = 16384;
+// Emitter keys of surface bursts start here, below are the slots of emitting particles
+static const uint32_t SURFACE_BURST_EMITTER = 0xC0000000u;
+
+ParticlePool::ParticlePool(unsigned int capacity, unsigned int threadCount) : mCapacity(capacity), mWorkers(threadCount), mGrid(mWorkers)
+{
+	mParticles.resize(capacity);
+	mAlive.resize(capacity);
+	mIds.resize(capacity);
+	mFreeSlots.reserve(capacity);
+	Reset(nullptr, 0);
+}
+
+void ParticlePool::Reset(const particlestruct* particles, unsigned int count)
+{
+	std::fill(mAlive.begin(), mAlive.end(), 0);
+	// the lowest slots are on top of the stack, which keeps the used slots packed at the start
+	mFreeSlots.clear();
+	for (unsigned int i = mCapacity; i > 0; i--)
+		mFreeSlots.push_back(i - 1);
+	mHighWater = 0;
+	mNextId = 0;
+	mOverflow = 0;
+	mFrame = 0;
+	mTime = 0.0f;
+	mSurfaceBursts = 0;
+
+	for (unsigned int i = 0; i < count; i++)
+		Spawn(particles[i].position, particles[i].velocity, particles[i].lifeTime, particles[i].type);
+}
+
+unsigned int ParticlePool::Spawn(glm::vec3 position, glm::vec3 velocity, float lifeTime, float type)
+{
+	if (mFreeSlots.empty())
+	{
+		mOverflow++;
+		return INVALID_SLOT;
+	}
+
+	unsigned int slot = mFreeSlots.back();
+	mFreeSlots.pop_back();
+	mHighWater = std::max(mHighWater, slot + 1);
+
+	mParticles.positionX[slot] = position.x;
+	mParticles.positionY[slot] = position.y;
+	mParticles.positionZ[slot] = position.z;
+	mParticles.velocityX[slot] = velocity.x;
+	mParticles.velocityY[slot] = velocity.y;
+	mParticles.velocityZ[slot] = velocity.z;
+	mParticles.lifeTime[slot] = lifeTime;
+	mParticles.type[slot] = type;
+	mAlive[slot] = 1;
+	mIds[slot] = mNextId++;
+	return slot;
+}
+
+unsigned int ParticlePool::SpawnOnSurface(const EmissionSurface& surface, unsigned int count, float type, float speed, float lifeTime)
+{
+	if (surface.TriangleCount() == 0)
+		return 0;
+
+	uint32_t emitter = SURFACE_BURST_EMITTER | (mSurfaceBursts++ & ~SURFACE_BURST_EMITTER);
+	unsigned int spawned = 0;
+	for (unsigned int n = 0; n < count; n++)
+	{
+		glm::vec3 velocity = type == TYPE_A ? SpawnVelocity(mFrame, emitter, n) * speed : glm::vec3(0.0f);
+		if (Spawn(surface.Sample(RandomKey(mFrame, emitter, n)), velocity, lifeTime, type) != INVALID_SLOT)
+			spawned++;
+	}
+	return spawned;
+}
+
+void ParticlePool::Kill(unsigned int slot)
+{
+	if (!mAlive[slot])
+		return;
+	mAlive[slot] = 0;
+	mFreeSlots.push_back(slot);
+}
+
+void ParticlePool::updateChunk(unsigned int begin, unsigned int end, ChunkResult& result, float deltaTime, bool spawnNewEmitter, glm::vec3 spawnPosition)
+{
+	ParticleArrays& p = mParticles;
+	bool turbulence = Turbulence.Enabled && TurbulenceField != nullptr;
+	for (unsigned int i = begin; i < end; i++)
+	{
+		if (!mAlive[i])
+			continue;
+
+		float oldLifeTime = p.lifeTime[i];
+		float lifeTime = oldLifeTime + deltaTime;
+		float type = p.type[i];
+
+		if (type == TYPE_A && oldLifeTime < PARTICLE_LIFETIME)
+		{
+			p.positionX[i] += p.velocityX[i] * deltaTime;
+			p.positionY[i] += p.velocityY[i] * deltaTime;
+			p.positionZ[i] += p.velocityZ[i] * deltaTime;
+			p.velocityY[i] += GRAVITY * deltaTime;
+			if (turbulence)
+			{
+				glm::vec3 force = TurbulenceField->Force(glm::vec3(p.positionX[i], p.positionY[i], p.positionZ[i]), Turbulence, mTime) * deltaTime;
+				p.velocityX[i] += force.x;
+				p.velocityY[i] += force.y;
+				p.velocityZ[i] += force.z;
+			}
+			p.lifeTime[i] = lifeTime;
+		}
+		else if (type == PRIMARY_EMITTER)
+		{
+			p.velocityX[i] = p.velocityY[i] = p.velocityZ[i] = 0.0f;
+			p.lifeTime[i] = lifeTime;
+			if (spawnNewEmitter)
+				result.spawns.push_back({ spawnPosition, glm::vec3(spawnPosition.y, 0.0f, 0.0f), spawnPosition.x, EMITTER, PRIMARY_EMITTER_SPAWN_AMOUNT, INVALID_SLOT });
+		}
+		else if (type == EMITTER && lifeTime < EMITTER_LIFETIME)
+		{
+			// velocity is used as spawn timer for emitters
+			glm::vec3 position(p.positionX[i], p.positionY[i], p.positionZ[i]);
+			if (p.velocityX[i] > EMITTER_SPAWN_INTERVAL)
+			{
+				result.spawns.push_back({ position, glm::vec3(0.0f), 0.0f, TYPE_A, EMITTER_SPAWN_AMOUNT, i });
+				p.velocityX[i] = p.velocityY[i] = p.velocityZ[i] = 0.0f;
+			}
+			else
+			{
+				p.velocityX[i] += deltaTime;
+			}
+			p.lifeTime[i] = lifeTime;
+		}
+		else
+		{
+			result.kills.push_back(i);
+		}
+	}
+}
+
+void ParticlePool::Update(float deltaTime, bool spawnNewEmitter, glm::vec3 spawnPosition)
+{
+	unsigned int chunks = (mHighWater + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	if (mChunkResults.size() < chunks)
+		mChunkResults.resize(chunks);
+
+	mWorkers.Run(chunks, [&](unsigned int chunk) {
+		ChunkResult& result = mChunkResults[chunk];
+		result.kills.clear();
+		result.spawns.clear();
+		updateChunk(chunk * CHUNK_SIZE, std::min(mHighWater, (chunk + 1) * CHUNK_SIZE), result, deltaTime, spawnNewEmitter, spawnPosition);
+	});
+
+	// kill first so the freed slots are available to this update's spawns
+	for (unsigned int chunk = 0; chunk < chunks; chunk++)
+	{
+		for (unsigned int slot : mChunkResults[chunk].kills)
+			Kill(slot);
+	}
+	for (unsigned int chunk = 0; chunk < chunks; chunk++)
+	{
+		for (const SpawnRequest& spawn : mChunkResults[chunk].spawns)
+		{
+			for (unsigned int n = 0; n < spawn.amount; n++)
+			{
+				glm::vec3 velocity = spawn.emitter == INVALID_SLOT ? spawn.velocity : SpawnVelocity(mFrame, spawn.emitter, n);
+				Spawn(spawn.position, velocity, spawn.lifeTime, spawn.type);
+			}
+		}
+	}
+
+	if (Interaction.Enabled)
+	{
+		mGrid.Build(mParticles, mAlive.data(), mHighWater, Interaction.CellSize);
+		mGrid.Interact(mParticles, mAlive.data(), mHighWater, Interaction, deltaTime);
+	}
+	mFrame++;
+	mTime += deltaTime;
+}
+
+unsigned int ParticlePool::CopyTo(particlestruct* particles) const
+{
+	unsigned int count = 0;
+	for (unsigned int i = 0; i < mHighWater; i++)
+	{
+		if (!mAlive[i])
+			continue;
+		particles[count].position = glm::vec3(mParticles.positionX[i], mParticles.positionY[i], mParticles.positionZ[i]);
+		particles[count].velocity = glm::vec3(mParticles.velocityX[i], mParticles.velocityY[i], mParticles.velocityZ[i]);
+		particles[count].lifeTime = mParticles.lifeTime[i];
+		particles[count].type = mParticles.type[i];
+		count++;
+	}
+	return count;
+}
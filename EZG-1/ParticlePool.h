@@ -0,0 +1,98 @@
+#pragma once
+#include "glm/glm.hpp"
+
+#include "EmissionSurface.h"
+#include "ForceField.h"
+#include "Particles.h"
+#include "ParticleSimulator.h"
+#include "SpatialHash.h"
+#include "WorkerPool.h"
+
+#include <vector>
+
+// Fixed capacity particle pool with a stack of free slot indices. Spawning pops a slot and killing pushes it
+// back, both O(1), and a particle keeps its slot and ID for its whole life, so per particle data stored
+// by slot persists across updates without copying. Spawns that find the pool full are counted as overflow.
+class ParticlePool
+{
+public:
+	static const unsigned int INVALID_SLOT = 0xFFFFFFFF;
+
+	// threadCount 0 uses one thread per hardware thread
+	ParticlePool(unsigned int capacity, unsigned int threadCount = 0);
+
+	void Reset(const particlestruct* particles, unsigned int count);
+
+	// Returns the slot of the new particle, or INVALID_SLOT when the pool is full
+	unsigned int Spawn(glm::vec3 position, glm::vec3 velocity, float lifeTime, float type);
+	void Kill(unsigned int slot);
+	// Spawns count particles spread uniformly over the surface, returns the number that found a free slot.
+	// TYPE_A particles get a random spawn velocity scaled by speed.
+	unsigned int SpawnOnSurface(const EmissionSurface& surface, unsigned int count, float type, float speed = 1.0f, float lifeTime = 0.0f);
+	bool Alive(unsigned int slot) const { return mAlive[slot] != 0; }
+
+	// Same rules as particleTransformGS.glsl, particles are updated in place and spawn after the update.
+	// With interaction enabled the particles are sorted into the grid afterwards and repel each other.
+	void Update(float deltaTime, bool spawnNewEmitter, glm::vec3 spawnPosition);
+
+	ParticleInteraction Interaction;
+	// Curl noise acceleration of the TYPE_A particles, only applied while a field is set
+	ParticleForceField Turbulence;
+	const ForceField* TurbulenceField = nullptr;
+	// Grid of the last update, also holds the terrain the particles collide with
+	SpatialHash& Grid() { return mGrid; }
+
+	// Packs the alive particles into the transform feedback layout, returns the number written
+	unsigned int CopyTo(particlestruct* particles) const;
+
+	// Particle data and IDs by slot, only valid for alive slots
+	const ParticleArrays& Particles() const { return mParticles; }
+	const std::vector<unsigned int>& Ids() const { return mIds; }
+
+	unsigned int Count() const { return mCapacity - (unsigned int)mFreeSlots.size(); }
+	unsigned int Capacity() const { return mCapacity; }
+	// Slots below this have been used since the last reset, updates never look past it
+	unsigned int HighWater() const { return mHighWater; }
+	// Spawns dropped since the last reset because the pool was full
+	unsigned int Overflow() const { return mOverflow; }
+
+private:
+	struct SpawnRequest
+	{
+		glm::vec3 position;
+		glm::vec3 velocity;
+		float lifeTime;
+		float type;
+		unsigned int amount;
+		// spawning emitter slot, TYPE_A spawns draw their velocity from it instead of using velocity
+		unsigned int emitter;
+	};
+
+	// kills and spawns found by one update task, applied in task order afterwards
+	struct ChunkResult
+	{
+		std::vector<unsigned int> kills;
+		std::vector<SpawnRequest> spawns;
+	};
+
+	unsigned int mCapacity;
+	ParticleArrays mParticles;
+	std::vector<unsigned char> mAlive;
+	std::vector<unsigned int> mIds;
+	std::vector<unsigned int> mFreeSlots;
+	unsigned int mHighWater = 0;
+	unsigned int mNextId = 0;
+	unsigned int mOverflow = 0;
+	// updates since the last reset, keys the spawn velocities
+	uint32_t mFrame = 0;
+	// seconds simulated since the last reset, scrolls the force field
+	float mTime = 0.0f;
+	// surface bursts since the last reset, keys their random numbers
+	uint32_t mSurfaceBursts = 0;
+
+	WorkerPool mWorkers;
+	SpatialHash mGrid;
+	std::vector<ChunkResult> mChunkResults;
+
+	void updateChunk(unsigned int begin, unsigned int end, ChunkResult& result, float deltaTime, bool spawnNewEmitter, glm::vec3 spawnPosition);
+};
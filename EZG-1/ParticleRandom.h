@@ -0,0 +1,37 @@
+#pragma once
+#include "glm/glm.hpp"
+
+#include <cstdint>
+
+// Stateless counter based random numbers, the same functions as Shaders/particleRandom.glsl.
+// Values only depend on the key, so a spawn gets the same random numbers on the CPU and the GPU
+// and every run of a benchmark sees the same particles, without a random texture or stored state.
+
+// PCG hash, one round of the PCG RXS M XS generator on the input
+inline uint32_t PcgHash(uint32_t value)
+{
+	uint32_t state = value * 747796405u + 2891336453u;
+	uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+// Key of the index-th particle spawned by an emitter in an update
+inline uint32_t RandomKey(uint32_t frame, uint32_t emitter, uint32_t index)
+{
+	return PcgHash(index ^ PcgHash(emitter ^ PcgHash(frame)));
+}
+
+// Uniform float in [0, 1) from the upper 24 bits, exactly representable so both sides agree bit for bit
+inline float RandomFloat(uint32_t bits)
+{
+	return float(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+// Three uniform floats in [0, 1), the key is hashed once per component
+inline glm::vec3 RandomVec3(uint32_t key)
+{
+	uint32_t x = PcgHash(key);
+	uint32_t y = PcgHash(x);
+	uint32_t z = PcgHash(y);
+	return glm::vec3(RandomFloat(x), RandomFloat(y), RandomFloat(z));
+}
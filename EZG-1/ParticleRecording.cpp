@@ -0,0 +1,90 @@
+#include "ParticleRecording.h"
+
+#include <cstring>
+#include <iostream>
+
+static const char RECORDING_MAGIC[4] = { 'P', 'R', '0', '1' };
+
+// Flag bits of a recorded frame
+static const unsigned char FRAME_SPAWN = 1;
+
+ParticleRecorder::ParticleRecorder(const std::string& path) : mFile(path, std::ios::binary | std::ios::trunc)
+{
+	if (!mFile)
+	{
+		std::cout << "ERROR::RECORDING::FILE_NOT_WRITABLE " << path << std::endl;
+		return;
+	}
+	mFile.write(RECORDING_MAGIC, 4);
+}
+
+void ParticleRecorder::Record(const ParticleFrame& frame)
+{
+	unsigned char flags = frame.spawn ? FRAME_SPAWN : 0;
+	mFile.write(reinterpret_cast<const char*>(&frame.deltaTime), sizeof(float));
+	mFile.write(reinterpret_cast<const char*>(&flags), 1);
+	if (frame.spawn)
+		mFile.write(reinterpret_cast<const char*>(&frame.spawnPosition), sizeof(glm::vec3));
+	mFrames++;
+}
+
+ParticleReplay::ParticleReplay(const std::string& path, float fixedTimestep) : mFixedTimestep(fixedTimestep)
+{
+	std::ifstream file(path, std::ios::binary);
+	char magic[4];
+	if (!file.read(magic, 4) || memcmp(magic, RECORDING_MAGIC, 4) != 0)
+	{
+		std::cout << "ERROR::RECORDING::INVALID_FILE " << path << std::endl;
+		return;
+	}
+
+	ParticleFrame frame;
+	unsigned char flags;
+	while (file.read(reinterpret_cast<char*>(&frame.deltaTime), sizeof(float)) && file.read(reinterpret_cast<char*>(&flags), 1))
+	{
+		frame.spawn = (flags & FRAME_SPAWN) != 0;
+		frame.spawnPosition = glm::vec3(0.0f);
+		if (frame.spawn && !file.read(reinterpret_cast<char*>(&frame.spawnPosition), sizeof(glm::vec3)))
+			break;
+		mFrames.push_back(frame);
+	}
+
+	mStats.open(path + ".csv", std::ios::trunc);
+	mStats << "frame,deltaTime,particles,updateMs,renderMs" << std::endl;
+}
+
+bool ParticleReplay::Next(ParticleFrame& frame)
+{
+	if (mFrame >= mFrames.size())
+		return false;
+	frame = mFrames[mFrame++];
+	if (mFixedTimestep > 0.0f)
+		frame.deltaTime = mFixedTimestep;
+	return true;
+}
+
+void ParticleReplay::WriteStats(int count, double updateMilliseconds, double renderMilliseconds)
+{
+	unsigned int frame = mFrame - 1;
+	float deltaTime = mFixedTimestep > 0.0f ? mFixedTimestep : mFrames[frame].deltaTime;
+	mStats << frame << "," << deltaTime << "," << count << "," << updateMilliseconds << "," << renderMilliseconds << "\n";
+
+	mTotalUpdateMilliseconds += updateMilliseconds;
+	mTotalRenderMilliseconds += renderMilliseconds;
+	if (count >= 0)
+	{
+		mTotalCount += count;
+		mCountedFrames++;
+	}
+}
+
+void ParticleReplay::PrintSummary(const char* modeName) const
+{
+	if (mFrame == 0)
+		return;
+	std::cout << "Replay of " << mFrame << " frames with " << modeName << ": update " << mTotalUpdateMilliseconds / mFrame
+		<< " ms, render " << mTotalRenderMilliseconds / mFrame << " ms";
+	if (mCountedFrames > 0)
+		std::cout << ", " << double(mTotalCount) / mCountedFrames << " particles";
+	std::cout << " on average" << std::endl;
+}
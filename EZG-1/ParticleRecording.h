@@ -0,0 +1,59 @@
+#pragma once
+#include "glm/glm.hpp"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Input of one particle update, everything that differs between two runs of the particle systems
+struct ParticleFrame
+{
+	float deltaTime;
+	bool spawn;
+	glm::vec3 spawnPosition;
+};
+
+// Appends the particle input of every frame to a recording file.
+// File layout: magic, then per frame the time step, a flag byte and the spawn position only when the flag is set.
+class ParticleRecorder
+{
+public:
+	ParticleRecorder(const std::string& path);
+
+	void Record(const ParticleFrame& frame);
+	unsigned int Frames() const { return mFrames; }
+
+private:
+	std::ofstream mFile;
+	unsigned int mFrames = 0;
+};
+
+// Plays a recording back frame by frame and writes per frame particle counts and timings as CSV
+class ParticleReplay
+{
+public:
+	// A fixedTimestep above 0 replaces the recorded time steps, spawns stay on their recorded frames
+	ParticleReplay(const std::string& path, float fixedTimestep = 0.0f);
+
+	bool Valid() const { return !mFrames.empty(); }
+	// Returns false once every frame has been played
+	bool Next(ParticleFrame& frame);
+	unsigned int Frame() const { return mFrame; }
+	unsigned int Frames() const { return (unsigned int)mFrames.size(); }
+
+	// Stats of the frame returned by the last Next, count is -1 where the particle count is unknown
+	void WriteStats(int count, double updateMilliseconds, double renderMilliseconds);
+	// Prints the averages over the whole replay
+	void PrintSummary(const char* modeName) const;
+
+private:
+	std::vector<ParticleFrame> mFrames;
+	float mFixedTimestep;
+	unsigned int mFrame = 0;
+
+	std::ofstream mStats;
+	double mTotalUpdateMilliseconds = 0.0;
+	double mTotalRenderMilliseconds = 0.0;
+	long long mTotalCount = 0;
+	unsigned int mCountedFrames = 0;
+};
@@ -0,0 +1,343 @@
+#include "ParticleSimulator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Particles per task, a multiple of the vector width
+static const unsigned int CHUNK_SIZE = 16384;
+
+#ifdef __AVX2__
+// Lane permutations that move the lanes selected by an 8 bit mask to the front, used for stream compaction
+struct CompactTable
+{
+	alignas(32) int indices[256][8];
+
+	CompactTable()
+	{
+		for (int mask = 0; mask < 256; mask++)
+		{
+			int n = 0;
+			for (int lane = 0; lane < 8; lane++)
+			{
+				if (mask & (1 << lane))
+					indices[mask][n++] = lane;
+			}
+			while (n < 8)
+				indices[mask][n++] = 0;
+		}
+	}
+};
+
+static const CompactTable compactTable;
+#endif
+
+void ParticleArrays::resize(unsigned int size)
+{
+	positionX.resize(size);
+	positionY.resize(size);
+	positionZ.resize(size);
+	velocityX.resize(size);
+	velocityY.resize(size);
+	velocityZ.resize(size);
+	lifeTime.resize(size);
+	type.resize(size);
+}
+
+ParticleSimulator::ParticleSimulator(unsigned int capacity, unsigned int threadCount) : mCapacity(capacity), mWorkers(threadCount), mSorter(mWorkers)
+{
+	mCurrent.resize(capacity);
+	mNext.resize(capacity);
+	mSortKeys.resize(capacity);
+	mDrawOrder.resize(capacity);
+}
+
+void ParticleSimulator::Reset(const particlestruct* particles, unsigned int count)
+{
+	mCount = std::min(count, mCapacity);
+	mOverflow = count - mCount;
+	mFrame = 0;
+	for (unsigned int i = 0; i < mCount; i++)
+	{
+		mCurrent.positionX[i] = particles[i].position.x;
+		mCurrent.positionY[i] = particles[i].position.y;
+		mCurrent.positionZ[i] = particles[i].position.z;
+		mCurrent.velocityX[i] = particles[i].velocity.x;
+		mCurrent.velocityY[i] = particles[i].velocity.y;
+		mCurrent.velocityZ[i] = particles[i].velocity.z;
+		mCurrent.lifeTime[i] = particles[i].lifeTime;
+		mCurrent.type[i] = particles[i].type;
+	}
+}
+
+void ParticleSimulator::CopyTo(particlestruct* particles)
+{
+	mWorkers.Run(chunkCount(), [&](unsigned int chunk) {
+		unsigned int end = std::min(mCount, (chunk + 1) * CHUNK_SIZE);
+		for (unsigned int i = chunk * CHUNK_SIZE; i < end; i++)
+		{
+			particles[i].position = glm::vec3(mCurrent.positionX[i], mCurrent.positionY[i], mCurrent.positionZ[i]);
+			particles[i].velocity = glm::vec3(mCurrent.velocityX[i], mCurrent.velocityY[i], mCurrent.velocityZ[i]);
+			particles[i].lifeTime = mCurrent.lifeTime[i];
+			particles[i].type = mCurrent.type[i];
+		}
+	});
+}
+
+void ParticleSimulator::SortBackToFront(const glm::mat4& modelView)
+{
+	// view space z row, the distance to the camera grows with -z
+	glm::vec4 depthRow(modelView[0][2], modelView[1][2], modelView[2][2], modelView[3][2]);
+
+	mWorkers.Run(chunkCount(), [&](unsigned int chunk) {
+		unsigned int end = std::min(mCount, (chunk + 1) * CHUNK_SIZE);
+		for (unsigned int i = chunk * CHUNK_SIZE; i < end; i++)
+		{
+			float depth = -(depthRow.x * mCurrent.positionX[i] + depthRow.y * mCurrent.positionY[i] + depthRow.z * mCurrent.positionZ[i] + depthRow.w);
+			// inverted so the farthest particle comes first
+			mSortKeys[i] = ~SortableKey(depth);
+			mDrawOrder[i] = i;
+		}
+	});
+
+	mSorter.Sort(mSortKeys, mDrawOrder, mCount);
+}
+
+unsigned int ParticleSimulator::chunkCount() const
+{
+	return (mCount + CHUNK_SIZE - 1) / CHUNK_SIZE;
+}
+
+// Number of particles the geometry shader would emit for the particles in [begin, end)
+unsigned int ParticleSimulator::countChunk(unsigned int begin, unsigned int end, float deltaTime, bool spawnNewEmitter) const
+{
+	unsigned int count = 0;
+	for (unsigned int i = begin; i < end; i++)
+	{
+		float type = mCurrent.type[i];
+		if (type == TYPE_A)
+		{
+			count += mCurrent.lifeTime[i] < PARTICLE_LIFETIME ? 1 : 0;
+		}
+		else if (type == PRIMARY_EMITTER)
+		{
+			count += 1 + (spawnNewEmitter ? PRIMARY_EMITTER_SPAWN_AMOUNT : 0);
+		}
+		else if (type == EMITTER && mCurrent.lifeTime[i] + deltaTime < EMITTER_LIFETIME)
+		{
+			count += 1 + (mCurrent.velocityX[i] > EMITTER_SPAWN_INTERVAL ? EMITTER_SPAWN_AMOUNT : 0);
+		}
+	}
+	return count;
+}
+
+void ParticleSimulator::write(unsigned int out, glm::vec3 position, glm::vec3 velocity, float lifeTime, float type)
+{
+	mNext.positionX[out] = position.x;
+	mNext.positionY[out] = position.y;
+	mNext.positionZ[out] = position.z;
+	mNext.velocityX[out] = velocity.x;
+	mNext.velocityY[out] = velocity.y;
+	mNext.velocityZ[out] = velocity.z;
+	mNext.lifeTime[out] = lifeTime;
+	mNext.type[out] = type;
+}
+
+// Scalar version of the geometry shader main(), returns the next output slot.
+// Outputs past outEnd are dropped, like primitives that no longer fit into the feedback buffer.
+unsigned int ParticleSimulator::updateParticle(unsigned int i, unsigned int out, unsigned int outEnd, float deltaTime, bool spawnNewEmitter, glm::vec3 spawnPosition)
+{
+	glm::vec3 position(mCurrent.positionX[i], mCurrent.positionY[i], mCurrent.positionZ[i]);
+	glm::vec3 velocity(mCurrent.velocityX[i], mCurrent.velocityY[i], mCurrent.velocityZ[i]);
+	float lifeTime = mCurrent.lifeTime[i] + deltaTime;
+	float type = mCurrent.type[i];
+
+	if (type == PRIMARY_EMITTER)
+	{
+		if (out < outEnd)
+			write(out, position, glm::vec3(0.0f), lifeTime, type);
+		out++;
+		if (spawnNewEmitter)
+		{
+			for (unsigned int n = 0; n < PRIMARY_EMITTER_SPAWN_AMOUNT; n++, out++)
+			{
+				if (out < outEnd)
+					write(out, spawnPosition, glm::vec3(spawnPosition.y, 0.0f, 0.0f), spawnPosition.x, EMITTER);
+			}
+		}
+	}
+	else if (type == EMITTER && lifeTime < EMITTER_LIFETIME)
+	{
+		// velocity is used as spawn timer for emitters
+		glm::vec3 timer = velocity + glm::vec3(deltaTime, 0.0f, 0.0f);
+		if (velocity.x > EMITTER_SPAWN_INTERVAL)
+		{
+			for (unsigned int n = 0; n < EMITTER_SPAWN_AMOUNT; n++, out++)
+			{
+				if (out < outEnd)
+					write(out, position, SpawnVelocity(mFrame, i, n), 0.0f, TYPE_A);
+			}
+			timer = glm::vec3(0.0f);
+		}
+		if (out < outEnd)
+			write(out, position, timer, lifeTime, type);
+		out++;
+	}
+	else if (type == TYPE_A && mCurrent.lifeTime[i] < PARTICLE_LIFETIME)
+	{
+		if (out < outEnd)
+			write(out, position + velocity * deltaTime, velocity + glm::vec3(0.0f, GRAVITY, 0.0f) * deltaTime, lifeTime, type);
+		out++;
+	}
+	return out;
+}
+
+void ParticleSimulator::updateChunk(unsigned int begin, unsigned int end, unsigned int out, unsigned int outEnd, float deltaTime, bool spawnNewEmitter, glm::vec3 spawnPosition)
+{
+	unsigned int i = begin;
+#ifdef __AVX2__
+	const __m256 typeA = _mm256_set1_ps(TYPE_A);
+	const __m256 particleLifeTime = _mm256_set1_ps(PARTICLE_LIFETIME);
+	const __m256 dt = _mm256_set1_ps(deltaTime);
+	const __m256 gravity = _mm256_set1_ps(GRAVITY * deltaTime);
+
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 type = _mm256_loadu_ps(&mCurrent.type[i]);
+		int typeAMask = _mm256_movemask_ps(_mm256_cmp_ps(type, typeA, _CMP_EQ_OQ));
+
+		// emitters are rare, groups containing one take the scalar path
+		if (typeAMask != 0xFF)
+		{
+			for (unsigned int lane = 0; lane < 8; lane++)
+				out = updateParticle(i + lane, out, outEnd, deltaTime, spawnNewEmitter, spawnPosition);
+			continue;
+		}
+
+		__m256 lifeTime = _mm256_loadu_ps(&mCurrent.lifeTime[i]);
+		int aliveMask = _mm256_movemask_ps(_mm256_cmp_ps(lifeTime, particleLifeTime, _CMP_LT_OQ));
+		unsigned int alive = (unsigned int)_mm_popcnt_u32(aliveMask);
+		if (alive == 0)
+			continue;
+
+		// the packed stores write all 8 lanes, near the end of the chunk fall back to scalar writes
+		if (out + 8 > outEnd)
+		{
+			for (unsigned int lane = 0; lane < 8; lane++)
+				out = updateParticle(i + lane, out, outEnd, deltaTime, spawnNewEmitter, spawnPosition);
+			continue;
+		}
+
+		__m256 velocityX = _mm256_loadu_ps(&mCurrent.velocityX[i]);
+		__m256 velocityY = _mm256_loadu_ps(&mCurrent.velocityY[i]);
+		__m256 velocityZ = _mm256_loadu_ps(&mCurrent.velocityZ[i]);
+		__m256 positionX = _mm256_add_ps(_mm256_loadu_ps(&mCurrent.positionX[i]), _mm256_mul_ps(velocityX, dt));
+		__m256 positionY = _mm256_add_ps(_mm256_loadu_ps(&mCurrent.positionY[i]), _mm256_mul_ps(velocityY, dt));
+		__m256 positionZ = _mm256_add_ps(_mm256_loadu_ps(&mCurrent.positionZ[i]), _mm256_mul_ps(velocityZ, dt));
+
+		__m256i compact = _mm256_load_si256(reinterpret_cast<const __m256i*>(compactTable.indices[aliveMask]));
+		_mm256_storeu_ps(&mNext.positionX[out], _mm256_permutevar8x32_ps(positionX, compact));
+		_mm256_storeu_ps(&mNext.positionY[out], _mm256_permutevar8x32_ps(positionY, compact));
+		_mm256_storeu_ps(&mNext.positionZ[out], _mm256_permutevar8x32_ps(positionZ, compact));
+		_mm256_storeu_ps(&mNext.velocityX[out], _mm256_permutevar8x32_ps(velocityX, compact));
+		_mm256_storeu_ps(&mNext.velocityY[out], _mm256_permutevar8x32_ps(_mm256_add_ps(velocityY, gravity), compact));
+		_mm256_storeu_ps(&mNext.velocityZ[out], _mm256_permutevar8x32_ps(velocityZ, compact));
+		_mm256_storeu_ps(&mNext.lifeTime[out], _mm256_permutevar8x32_ps(_mm256_add_ps(lifeTime, dt), compact));
+		_mm256_storeu_ps(&mNext.type[out], typeA);
+		out += alive;
+	}
+#endif
+	for (; i < end; i++)
+		out = updateParticle(i, out, outEnd, deltaTime, spawnNewEmitter, spawnPosition);
+}
+
+void ParticleSimulator::Update(float deltaTime, bool spawnNewEmitter, glm::vec3 spawnPosition)
+{
+	unsigned int chunks = chunkCount();
+	mChunkCounts.resize(chunks);
+	mChunkOffsets.resize(chunks);
+
+	// 1. count the outputs of every chunk
+	mWorkers.Run(chunks, [&](unsigned int chunk) {
+		mChunkCounts[chunk] = countChunk(chunk * CHUNK_SIZE, std::min(mCount, (chunk + 1) * CHUNK_SIZE), deltaTime, spawnNewEmitter);
+	});
+
+	// 2. prefix sum gives every chunk its output range, in the same order as the geometry shader output
+	unsigned int total = 0;
+	for (unsigned int chunk = 0; chunk < chunks; chunk++)
+	{
+		mChunkOffsets[chunk] = total;
+		total += mChunkCounts[chunk];
+	}
+
+	// 3. write the chunks, whatever lands past the capacity is dropped
+	mWorkers.Run(chunks, [&](unsigned int chunk) {
+		unsigned int out = mChunkOffsets[chunk];
+		unsigned int outEnd = std::min(mCapacity, out + mChunkCounts[chunk]);
+		if (out < outEnd)
+			updateChunk(chunk * CHUNK_SIZE, std::min(mCount, (chunk + 1) * CHUNK_SIZE), out, outEnd, deltaTime, spawnNewEmitter, spawnPosition);
+	});
+
+	std::swap(mCurrent, mNext);
+	mCount = std::min(total, mCapacity);
+	mOverflow = total - mCount;
+	mFrame++;
+}
+
+void ParticleSimulator::Benchmark(const std::vector<unsigned int>& particleCounts, unsigned int steps)
+{
+	const float deltaTime = 1.0f / 60.0f;
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+
+	// no particle lives through more than PARTICLE_LIFETIME of updates, the pool is refilled outside the timed
+	// region every batch so every timed update runs on the full count
+	unsigned int batchSteps = std::max(1u, (unsigned int)(PARTICLE_LIFETIME / deltaTime) - 2);
+	float seedAge = std::max(0.0f, PARTICLE_LIFETIME - (batchSteps + 1) * deltaTime);
+
+	std::cout << "Particle simulator benchmark, " << steps << " steps" << std::endl;
+	for (unsigned int count : particleCounts)
+	{
+		// TYPE_A particles young enough to survive a batch, with an emitter every 1000 particles
+		std::vector<particlestruct> particles(count);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			particles[i].position = glm::vec3(distribution(random), distribution(random), distribution(random));
+			particles[i].velocity = glm::vec3(distribution(random), distribution(random), distribution(random));
+			particles[i].lifeTime = distribution(random) * seedAge;
+			particles[i].type = i % 1000 == 0 ? EMITTER : TYPE_A;
+		}
+
+		for (unsigned int threads : { 1u, 0u })
+		{
+			// leave room for the spawned particles
+			ParticleSimulator simulator(count * 2, threads);
+			simulator.Reset(particles.data(), count);
+			simulator.Update(deltaTime, false, glm::vec3(0.0f));
+
+			double seconds = 0.0;
+			unsigned int minAlive = count;
+			for (unsigned int step = 0; step < steps; )
+			{
+				simulator.Reset(particles.data(), count);
+				unsigned int batchEnd = std::min(step + batchSteps, steps);
+				auto start = std::chrono::high_resolution_clock::now();
+				for (; step < batchEnd; step++)
+					simulator.Update(deltaTime, false, glm::vec3(0.0f));
+				seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+				minAlive = std::min(minAlive, simulator.Count());
+			}
+			if (minAlive < count - count / 100)
+				std::cout << "ERROR::PARTICLE_SIMULATOR::BENCHMARK_POOL_DRAINED " << minAlive << " of " << count << " alive" << std::endl;
+
+			double milliseconds = seconds * 1000.0 / steps;
+			std::cout << count << " particles, " << simulator.mWorkers.ThreadCount() << " threads: " << milliseconds << " ms/update, "
+				<< (milliseconds * 1000000.0 / count) << " ns/particle, at least " << minAlive << " alive" << std::endl;
+		}
+	}
+}
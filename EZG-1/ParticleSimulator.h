@@ -0,0 +1,71 @@
+#pragma once
+#include "glm/glm.hpp"
+
+#include "Particles.h"
+#include "RadixSort.h"
+#include "WorkerPool.h"
+
+#include <vector>
+
+// Particle state in structure of arrays layout
+struct ParticleArrays
+{
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> velocityX, velocityY, velocityZ;
+	std::vector<float> lifeTime;
+	std::vector<float> type;
+
+	void resize(unsigned int size);
+};
+
+// CPU implementation of the particle update in particleTransformGS.glsl. Every update streams the live
+// particles into a second set of arrays, in the same order and with the same emitter, primary emitter and
+// TYPE_A rules as the transform feedback pass, including dropping whatever does not fit into the capacity.
+class ParticleSimulator
+{
+public:
+	// threadCount 0 uses one thread per hardware thread
+	ParticleSimulator(unsigned int capacity, unsigned int threadCount = 0);
+
+	void Reset(const particlestruct* particles, unsigned int count);
+	void Update(float deltaTime, bool spawnNewEmitter, glm::vec3 spawnPosition);
+
+	// Interleaves the particles into the transform feedback layout, for uploading
+	void CopyTo(particlestruct* particles);
+
+	// Sorts the particle indices back to front by view depth into DrawOrder, modelView takes particles to view space
+	void SortBackToFront(const glm::mat4& modelView);
+	const std::vector<uint32_t>& DrawOrder() const { return mDrawOrder; }
+
+	const ParticleArrays& Particles() const { return mCurrent; }
+	unsigned int Count() const { return mCount; }
+	unsigned int Capacity() const { return mCapacity; }
+	// Particles dropped in the last update because the capacity was exceeded
+	unsigned int Overflow() const { return mOverflow; }
+
+	// Prints update times for the given particle counts, single threaded and with all threads
+	static void Benchmark(const std::vector<unsigned int>& particleCounts, unsigned int steps);
+
+private:
+	unsigned int mCapacity;
+	unsigned int mCount = 0;
+	unsigned int mOverflow = 0;
+	// updates since the last reset, keys the spawn velocities
+	uint32_t mFrame = 0;
+	ParticleArrays mCurrent;
+	ParticleArrays mNext;
+	WorkerPool mWorkers;
+	RadixSort mSorter;
+	std::vector<uint32_t> mSortKeys;
+	std::vector<uint32_t> mDrawOrder;
+
+	// per chunk output counts and offsets of the current update
+	std::vector<unsigned int> mChunkCounts;
+	std::vector<unsigned int> mChunkOffsets;
+
+	unsigned int chunkCount() const;
+	unsigned int countChunk(unsigned int begin, unsigned int end, float deltaTime, bool spawnNewEmitter) const;
+	void updateChunk(unsigned int begin, unsigned int end, unsigned int out, unsigned int outEnd, float deltaTime, bool spawnNewEmitter, glm::vec3 spawnPosition);
+	unsigned int updateParticle(unsigned int i, unsigned int out, unsigned int outEnd, float deltaTime, bool spawnNewEmitter, glm::vec3 spawnPosition);
+	void write(unsigned int out, glm::vec3 position, glm::vec3 velocity, float lifeTime, float type);
+};
@@ -0,0 +1,84 @@
+#include "ParticleTrails.h"
+
+// Same layout as TrailHeader in particleSimulateCS.glsl and particleTrailVS.glsl
+struct TrailHeader
+{
+	// slot of the emitter + 1, 0 while the trail is free
+	GLuint owner;
+	// ring index of the newest point and the number of points written
+	GLuint head;
+	GLuint count;
+	// seconds since the newest point was started
+	float timer;
+};
+
+ParticleTrails::ParticleTrails(unsigned int trailCount, unsigned int length) : mTrailCount(trailCount), mLength(length < 2 ? 2 : length)
+{
+	glGenBuffers(1, &mHeaderBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mHeaderBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(TrailHeader) * mTrailCount, nullptr, GL_DYNAMIC_COPY);
+
+	// xyz position in the space of the particles, w unused
+	glGenBuffers(1, &mPointBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mPointBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLfloat) * 4 * mTrailCount * mLength, nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// the points are pulled from the storage buffers, the VAO stays empty
+	glGenVertexArrays(1, &mVAO);
+
+	Clear();
+	LoadShaders();
+}
+
+ParticleTrails::~ParticleTrails()
+{
+	glDeleteBuffers(1, &mHeaderBuffer);
+	glDeleteBuffers(1, &mPointBuffer);
+	glDeleteVertexArrays(1, &mVAO);
+	delete mRenderShader;
+}
+
+void ParticleTrails::LoadShaders()
+{
+	delete mRenderShader;
+	mRenderShader = new Shader("Shaders/particleTrailVS.glsl", "Shaders/particleRenderPS.glsl");
+}
+
+void ParticleTrails::Clear()
+{
+	// the points of a free trail are never read, only the headers need clearing
+	GLuint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mHeaderBuffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void ParticleTrails::Bind()
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, HEADER_BINDING, mHeaderBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, POINT_BINDING, mPointBuffer);
+}
+
+void ParticleTrails::Render(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model, float width, ParticleBlendMode blending)
+{
+	Bind();
+	mRenderShader->use();
+	mRenderShader->setMat4("projection", projection);
+	mRenderShader->setMat4("view", view);
+	mRenderShader->setMat4("model", model);
+	mRenderShader->setInt("trailLength", mLength);
+	mRenderShader->setFloat("trailWidth", width);
+	mRenderShader->setInt("blendMode", blending);
+	mRenderShader->setFloat("opacity", PARTICLE_OPACITY);
+
+	// two vertices per point, free and too short trails collapse their strip outside the view
+	glBindVertexArray(mVAO);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 2 * mLength, mTrailCount);
+	glBindVertexArray(0);
+}
+
+size_t ParticleTrails::MemoryBytes() const
+{
+	return sizeof(TrailHeader) * mTrailCount + sizeof(GLfloat) * 4 * mTrailCount * mLength;
+}
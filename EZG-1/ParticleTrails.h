@@ -0,0 +1,58 @@
+#pragma once
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+#include "Shader.h"
+#include "ParticleTransparency.h"
+
+// Settings of the emitter trails of ComputeParticleSystem
+struct ParticleTrailSettings
+{
+	bool Enabled = false;
+	// seconds between two history points, the newest point follows the emitter in between
+	float SampleInterval = 0.05f;
+	// view space half width of the ribbon at the emitter, it tapers off towards the oldest point
+	float Width = 0.15f;
+	// emitters stand still otherwise, this lets them wander along the curl noise field so the trails show
+	float EmitterDrift = 4.0f;
+};
+
+// History of the emitters as fixed length rings of points on the GPU, one ring per trail. The simulate pass
+// of ComputeParticleSystem gives every emitter a trail of its own: the emitter slot maps to a trail, and the
+// emitter claims the first free one of the 8 trails from there (TRAIL_PROBES in particleSimulateCS.glsl) with
+// an atomic and appends its position to it. At most TrailCount() emitters have a trail. Emitters whose 8 trails
+// are all held by others get none, ParticleCounters::traillessCount counts them every update.
+// Rendering pulls the points in the vertex shader and expands them into camera facing ribbons, one instanced
+// triangle strip per trail. Nothing is built or uploaded on the CPU, memory is TrailCount() * Length() points.
+class ParticleTrails
+{
+public:
+	// Buffer bindings of the trails, the particle buffers keep theirs
+	static const GLuint HEADER_BINDING = 16;
+	static const GLuint POINT_BINDING = 17;
+
+	ParticleTrails(unsigned int trailCount = 256, unsigned int length = 64);
+	~ParticleTrails();
+
+	// (Re)loads the ribbon shader, called on shader hot reloading
+	void LoadShaders();
+	// Releases every trail, call when emitters may have died without releasing theirs
+	void Clear();
+	// Binds the trails for the simulate pass
+	void Bind();
+	// Draws the ribbons with the blending of the particles, the caller sets up the blend state
+	void Render(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model, float width, ParticleBlendMode blending);
+
+	unsigned int TrailCount() const { return mTrailCount; }
+	unsigned int Length() const { return mLength; }
+	size_t MemoryBytes() const;
+
+private:
+	unsigned int mTrailCount;
+	unsigned int mLength;
+	GLuint mHeaderBuffer;
+	GLuint mPointBuffer;
+	GLuint mVAO;
+
+	Shader* mRenderShader = nullptr;
+};
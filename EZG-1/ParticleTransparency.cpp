@@ -0,0 +1,286 @@
+#include "ParticleTransparency.h"
+
+#include <iostream>
+
+ParticleTransparency::ParticleTransparency(int width, int height, float nearPlane, float farPlane, void (*drawQuad)())
+	: NearPlane(nearPlane), FarPlane(farPlane), mWidth(width), mHeight(height), mDrawQuad(drawQuad)
+{
+	createTargets();
+	LoadShaders();
+}
+
+ParticleTransparency::~ParticleTransparency()
+{
+	deleteTargets();
+	deleteLowResolutionTargets();
+	delete mCompositeShader;
+	delete mDownsampleShader;
+	delete mUpsampleShader;
+}
+
+void ParticleTransparency::LoadShaders()
+{
+	delete mCompositeShader;
+	delete mDownsampleShader;
+	delete mUpsampleShader;
+	// the fullscreen quad of the depth map debug view
+	mCompositeShader = new Shader("Shaders/debugVS.glsl", "Shaders/particleCompositePS.glsl");
+	mCompositeShader->use();
+	mCompositeShader->setInt("accumulation", 0);
+	mCompositeShader->setInt("revealage", 1);
+	mDownsampleShader = new Shader("Shaders/debugVS.glsl", "Shaders/particleDepthDownsamplePS.glsl");
+	mUpsampleShader = new Shader("Shaders/debugVS.glsl", "Shaders/particleUpsamplePS.glsl");
+}
+
+void ParticleTransparency::Resize(int width, int height)
+{
+	if (width == mWidth && height == mHeight)
+		return;
+	mWidth = width;
+	mHeight = height;
+	deleteTargets();
+	createTargets();
+	// created again at the new size by the next soft draw
+	deleteLowResolutionTargets();
+}
+
+void ParticleTransparency::createTargets()
+{
+	glGenTextures(1, &mAccumulationTexture);
+	glBindTexture(GL_TEXTURE_2D, mAccumulationTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, mWidth, mHeight, 0, GL_RGBA, GL_FLOAT, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenTextures(1, &mRevealageTexture);
+	glBindTexture(GL_TEXTURE_2D, mRevealageTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, mWidth, mHeight, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// same format as the default framebuffer, depth is blitted over from it
+	glGenRenderbuffers(1, &mDepthRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, mDepthRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, mWidth, mHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &mFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mAccumulationTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, mRevealageTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, mDepthRenderbuffer);
+	GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "ERROR::PARTICLES::OIT_FRAMEBUFFER_INCOMPLETE" << std::endl;
+
+	// sampleable copy of the scene depth for the soft mode
+	glGenTextures(1, &mSceneDepthTexture);
+	glBindTexture(GL_TEXTURE_2D, mSceneDepthTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, mWidth, mHeight, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &mSceneDepthFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mSceneDepthFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, mSceneDepthTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "ERROR::PARTICLES::SCENE_DEPTH_FRAMEBUFFER_INCOMPLETE" << std::endl;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ParticleTransparency::deleteTargets()
+{
+	glDeleteFramebuffers(1, &mFramebuffer);
+	glDeleteTextures(1, &mAccumulationTexture);
+	glDeleteTextures(1, &mRevealageTexture);
+	glDeleteRenderbuffers(1, &mDepthRenderbuffer);
+	glDeleteFramebuffers(1, &mSceneDepthFramebuffer);
+	glDeleteTextures(1, &mSceneDepthTexture);
+}
+
+void ParticleTransparency::createLowResolutionTargets()
+{
+	mLowDivisor = Divisor;
+	int width = (mWidth + mLowDivisor - 1) / mLowDivisor;
+	int height = (mHeight + mLowDivisor - 1) / mLowDivisor;
+
+	// premultiplied particle colour, filtered by the bilinear part of the upsample
+	glGenTextures(1, &mLowParticleTexture);
+	glBindTexture(GL_TEXTURE_2D, mLowParticleTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenTextures(1, &mLowLinearDepthTexture);
+	glBindTexture(GL_TEXTURE_2D, mLowLinearDepthTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// the particles are depth tested against the reduced depth, which is written by the downsample
+	glGenRenderbuffers(1, &mLowDepthRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, mLowDepthRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &mLowDepthFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mLowDepthFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mLowLinearDepthTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mLowDepthRenderbuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "ERROR::PARTICLES::LOW_DEPTH_FRAMEBUFFER_INCOMPLETE" << std::endl;
+
+	glGenFramebuffers(1, &mLowParticleFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mLowParticleFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mLowParticleTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mLowDepthRenderbuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "ERROR::PARTICLES::LOW_PARTICLE_FRAMEBUFFER_INCOMPLETE" << std::endl;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ParticleTransparency::deleteLowResolutionTargets()
+{
+	if (mLowDivisor == 0)
+		return;
+	glDeleteFramebuffers(1, &mLowDepthFramebuffer);
+	glDeleteFramebuffers(1, &mLowParticleFramebuffer);
+	glDeleteTextures(1, &mLowLinearDepthTexture);
+	glDeleteTextures(1, &mLowParticleTexture);
+	glDeleteRenderbuffers(1, &mLowDepthRenderbuffer);
+	mLowDivisor = 0;
+}
+
+void ParticleTransparency::beginSoft(GLuint framebuffer)
+{
+	if (mLowDivisor != Divisor)
+	{
+		deleteLowResolutionTargets();
+		createLowResolutionTargets();
+	}
+	int width = (mWidth + mLowDivisor - 1) / mLowDivisor;
+	int height = (mHeight + mLowDivisor - 1) / mLowDivisor;
+
+	// 1. copy the scene depth into a texture
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mSceneDepthFramebuffer);
+	glBlitFramebuffer(0, 0, mWidth, mHeight, 0, 0, mWidth, mHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+	// 2. nearest depth of every block into the low resolution depth buffer, linear depth for the fade next to it
+	glBindFramebuffer(GL_FRAMEBUFFER, mLowDepthFramebuffer);
+	glViewport(0, 0, width, height);
+	glDepthFunc(GL_ALWAYS);
+	mDownsampleShader->use();
+	mDownsampleShader->setInt("divisor", mLowDivisor);
+	mDownsampleShader->setFloat("nearPlane", NearPlane);
+	mDownsampleShader->setFloat("farPlane", FarPlane);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, mSceneDepthTexture);
+	mDrawQuad();
+	glDepthFunc(GL_LESS);
+
+	// 3. the particles draw at the low resolution, with the linear depth and the sprite bound for their fade
+	glBindFramebuffer(GL_FRAMEBUFFER, mLowParticleFramebuffer);
+	GLfloat clearColor[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	glClearBufferfv(GL_COLOR, 0, clearColor);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, mLowLinearDepthTexture);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, SpriteTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void ParticleTransparency::endSoft(GLuint framebuffer)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, mWidth, mHeight);
+	glDisable(GL_DEPTH_TEST);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	mUpsampleShader->use();
+	mUpsampleShader->setInt("divisor", mLowDivisor);
+	mUpsampleShader->setFloat("nearPlane", NearPlane);
+	mUpsampleShader->setFloat("farPlane", FarPlane);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, mLowParticleTexture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, mLowLinearDepthTexture);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, mSceneDepthTexture);
+	mDrawQuad();
+	glActiveTexture(GL_TEXTURE0);
+	glEnable(GL_DEPTH_TEST);
+}
+
+void ParticleTransparency::Begin(ParticleBlendMode mode, GLuint framebuffer)
+{
+	if (mode == PARTICLE_BLEND_OPAQUE)
+		return;
+	if (mode == PARTICLE_BLEND_SOFT)
+		beginSoft(framebuffer);
+
+	// translucent particles are tested against the scene but never hide each other
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+	if (mode == PARTICLE_BLEND_ALPHA)
+	{
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		return;
+	}
+	if (mode == PARTICLE_BLEND_SOFT)
+	{
+		// the particles blend premultiplied over each other, the target keeps their coverage in alpha
+		glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+		return;
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mFramebuffer);
+	glBlitFramebuffer(0, 0, mWidth, mHeight, 0, 0, mWidth, mHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+
+	GLfloat clearAccumulation[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	GLfloat clearRevealage[] = { 1.0f, 0.0f, 0.0f, 0.0f };
+	glClearBufferfv(GL_COLOR, 0, clearAccumulation);
+	glClearBufferfv(GL_COLOR, 1, clearRevealage);
+
+	// accumulation sums up, revealage multiplies by 1 - alpha
+	glBlendFunci(0, GL_ONE, GL_ONE);
+	glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+}
+
+void ParticleTransparency::End(ParticleBlendMode mode, GLuint framebuffer)
+{
+	if (mode == PARTICLE_BLEND_OPAQUE)
+		return;
+
+	if (mode == PARTICLE_BLEND_WEIGHTED)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glDisable(GL_DEPTH_TEST);
+		// the composite writes the average colour with alpha 1 - revealage
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		mCompositeShader->use();
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, mAccumulationTexture);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, mRevealageTexture);
+		mDrawQuad();
+		glActiveTexture(GL_TEXTURE0);
+		glEnable(GL_DEPTH_TEST);
+	}
+	else if (mode == PARTICLE_BLEND_SOFT)
+	{
+		endSoft(framebuffer);
+	}
+
+	glDisable(GL_BLEND);
+	glDepthMask(GL_TRUE);
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "glad/glad.h"
+
+#include "Shader.h"
+
+// How translucent particle sprites are combined, the blendMode uniform of particleRenderPS.glsl
+enum ParticleBlendMode {
+	PARTICLE_BLEND_OPAQUE,
+	// over operator in draw order, only correct when the particles are sorted back to front
+	PARTICLE_BLEND_ALPHA,
+	// weighted blended order independent transparency, needs no sorting
+	PARTICLE_BLEND_WEIGHTED,
+	// mist sprites at a fraction of the resolution, faded against the scene depth and upsampled depth aware
+	PARTICLE_BLEND_SOFT,
+	PARTICLE_BLEND_MODE_COUNT
+};
+
+const char* const particleBlendModeNames[] = { "opaque", "alpha blended", "weighted blended OIT", "low resolution soft" };
+
+// Opacity of the center of a translucent particle sprite
+const float PARTICLE_OPACITY = 0.35f;
+
+// Blend state of the particle draws. The weighted mode (McGuire and Bavoil 2013) adds the weighted premultiplied
+// colours into an RGBA16F accumulation target and multiplies the transmittances into an R8 revealage target,
+// both independent of the draw order. The composite pass divides out the weights and blends the average colour
+// over the framebuffer, drawn with the fullscreen quad of the caller.
+// The soft mode copies the scene depth, reduces it to the nearest depth per Divisor x Divisor block and draws
+// premultiplied particles into a target of that size, which cuts the fill cost by Divisor squared. Particles
+// fade out where they come close to the scene. The upsample takes the bilinear result where the four low
+// resolution depths agree with the full resolution one, and the closest one in depth on edges, so the
+// particles behind an edge do not bleed over it.
+class ParticleTransparency
+{
+public:
+	// drawQuad draws the fullscreen quad the composite and resampling passes run on, nearPlane and farPlane
+	// are the planes of the scene projection
+	ParticleTransparency(int width, int height, float nearPlane, float farPlane, void (*drawQuad)());
+	~ParticleTransparency();
+
+	// Resolution divisor of the soft mode, 1, 2 or 4
+	int Divisor = 2;
+	// Planes of the scene projection, for linear depths
+	float NearPlane;
+	float FarPlane;
+	// Sprite of the soft mode, its red channel scales the opacity
+	GLuint SpriteTexture = 0;
+
+	// (Re)loads the composite and resampling shaders, called on shader hot reloading
+	void LoadShaders();
+	void Resize(int width, int height);
+
+	// Sets up blending for the particle draws of mode. The weighted and soft modes draw into their own targets,
+	// which start with the depth of the framebuffer so the scene still hides the particles behind it.
+	void Begin(ParticleBlendMode mode, GLuint framebuffer = 0);
+	// Restores the default state, the weighted and soft modes composite their targets over framebuffer first
+	void End(ParticleBlendMode mode, GLuint framebuffer = 0);
+
+private:
+	int mWidth;
+	int mHeight;
+	void (*mDrawQuad)();
+	GLuint mFramebuffer = 0;
+	GLuint mAccumulationTexture = 0;
+	GLuint mRevealageTexture = 0;
+	GLuint mDepthRenderbuffer = 0;
+
+	// soft mode: copy of the scene depth, low resolution linear depth and particle targets sharing a depth buffer
+	int mLowDivisor = 0;
+	GLuint mSceneDepthFramebuffer = 0;
+	GLuint mSceneDepthTexture = 0;
+	GLuint mLowDepthFramebuffer = 0;
+	GLuint mLowLinearDepthTexture = 0;
+	GLuint mLowParticleFramebuffer = 0;
+	GLuint mLowParticleTexture = 0;
+	GLuint mLowDepthRenderbuffer = 0;
+
+	Shader* mCompositeShader = nullptr;
+	Shader* mDownsampleShader = nullptr;
+	Shader* mUpsampleShader = nullptr;
+
+	void createTargets();
+	void deleteTargets();
+	void createLowResolutionTargets();
+	void deleteLowResolutionTargets();
+	void beginSoft(GLuint framebuffer);
+	void endSoft(GLuint framebuffer);
+};
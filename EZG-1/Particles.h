@@ -0,0 +1,42 @@
+#pragma once
+#include "glm/glm.hpp"
+
+#include "ParticleRandom.h"
+
+const unsigned int MAX_PARTICLES = 100000;
+const unsigned int EMITTER_COUNT = 10;
+
+// Particle types, same values as the defines in particleTransformGS.glsl
+const float PRIMARY_EMITTER = 0.0f;
+const float EMITTER = 1.0f;
+const float TYPE_A = 2.0f;
+const float TYPE_B = 3.0f;
+
+// Update constants of particleTransformGS.glsl, shared by the CPU simulations
+const float EMITTER_LIFETIME = 10.0f;
+const float EMITTER_SPAWN_INTERVAL = 0.02f;
+const unsigned int EMITTER_SPAWN_AMOUNT = 20;
+const unsigned int PRIMARY_EMITTER_SPAWN_AMOUNT = 2;
+const float PARTICLE_LIFETIME = 1.0f;
+const float GRAVITY = 10.0f;
+
+// View space half size of the instanced billboards in particleBillboardVS.glsl,
+// about the on screen size of the clip space quads of particleRenderGS.glsl at a 60 degree field of view
+const float PARTICLE_BILLBOARD_SIZE = 0.35f;
+
+// Initial velocity of the index-th TYPE_A particle an emitter spawns in an update,
+// spawnVelocity() in particleRandom.glsl. Random direction in the upper half space.
+inline glm::vec3 SpawnVelocity(uint32_t frame, uint32_t emitter, uint32_t index)
+{
+	glm::vec3 r = RandomVec3(RandomKey(frame, emitter, index));
+	return glm::vec3(r.x * 2.0f - 1.0f, r.y, r.z * 2.0f - 1.0f) * 10.0f;
+}
+
+// Particle layout of the transform feedback buffers
+struct particlestruct
+{
+	glm::vec3 position;
+	glm::vec3 velocity;
+	float lifeTime;
+	float type;
+};
@@ -0,0 +1,109 @@
+#include "RadixSort.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+// Keys per task
+static const unsigned int CHUNK_SIZE = 65536;
+static const unsigned int RADIX = 256;
+
+RadixSort::RadixSort(WorkerPool& workers) : mWorkers(workers)
+{
+}
+
+void RadixSort::Sort(std::vector<uint32_t>& keys, std::vector<uint32_t>& values, unsigned int count)
+{
+	if (count < 2)
+		return;
+
+	unsigned int chunks = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	mKeys.resize(std::max<size_t>(mKeys.size(), keys.size()));
+	mValues.resize(std::max<size_t>(mValues.size(), values.size()));
+	mHistograms.resize(chunks * RADIX);
+
+	for (unsigned int shift = 0; shift < 32; shift += 8)
+	{
+		// 1. digit counts of every chunk
+		mWorkers.Run(chunks, [&](unsigned int chunk) {
+			unsigned int* histogram = &mHistograms[chunk * RADIX];
+			std::fill(histogram, histogram + RADIX, 0);
+			unsigned int end = std::min(count, (chunk + 1) * CHUNK_SIZE);
+			for (unsigned int i = chunk * CHUNK_SIZE; i < end; i++)
+				histogram[(keys[i] >> shift) & 0xFF]++;
+		});
+
+		// 2. prefix sum, digit major and chunk minor, keeps equal digits in input order
+		unsigned int total = 0;
+		bool singleDigit = false;
+		for (unsigned int digit = 0; digit < RADIX; digit++)
+		{
+			unsigned int digitCount = 0;
+			for (unsigned int chunk = 0; chunk < chunks; chunk++)
+			{
+				unsigned int n = mHistograms[chunk * RADIX + digit];
+				mHistograms[chunk * RADIX + digit] = total;
+				total += n;
+				digitCount += n;
+			}
+			singleDigit |= digitCount == count;
+		}
+		// every key has the same digit, the pass would not move anything
+		if (singleDigit)
+			continue;
+
+		// 3. scatter every chunk to its offsets
+		mWorkers.Run(chunks, [&](unsigned int chunk) {
+			unsigned int* offsets = &mHistograms[chunk * RADIX];
+			unsigned int end = std::min(count, (chunk + 1) * CHUNK_SIZE);
+			for (unsigned int i = chunk * CHUNK_SIZE; i < end; i++)
+			{
+				unsigned int out = offsets[(keys[i] >> shift) & 0xFF]++;
+				mKeys[out] = keys[i];
+				mValues[out] = values[i];
+			}
+		});
+
+		std::swap(keys, mKeys);
+		std::swap(values, mValues);
+	}
+}
+
+void RadixSort::Benchmark(const std::vector<unsigned int>& counts, unsigned int repetitions)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> distribution(0.0f, 100.0f);
+
+	std::cout << "CPU radix sort benchmark, " << repetitions << " repetitions" << std::endl;
+	for (unsigned int count : counts)
+	{
+		std::vector<uint32_t> depths(count);
+		for (unsigned int i = 0; i < count; i++)
+			depths[i] = SortableKey(distribution(random));
+
+		for (unsigned int threads : { 1u, 0u })
+		{
+			WorkerPool workers(threads);
+			RadixSort sort(workers);
+			std::vector<uint32_t> keys(count), values(count);
+
+			double seconds = 0.0;
+			for (unsigned int repetition = 0; repetition < repetitions; repetition++)
+			{
+				keys = depths;
+				for (unsigned int i = 0; i < count; i++)
+					values[i] = i;
+
+				auto start = std::chrono::high_resolution_clock::now();
+				sort.Sort(keys, values, count);
+				seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+			}
+
+			double milliseconds = seconds * 1000.0 / repetitions;
+			std::cout << count << " keys, " << workers.ThreadCount() << " threads: " << milliseconds << " ms/sort, "
+				<< (milliseconds * 1000000.0 / count) << " ms per million keys"
+				<< (std::is_sorted(keys.begin(), keys.end()) ? "" : ", NOT SORTED") << std::endl;
+		}
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "WorkerPool.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Maps a float to an unsigned key with the same ordering, negative values included
+inline uint32_t SortableKey(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return bits ^ ((bits >> 31) ? 0xFFFFFFFFu : 0x80000000u);
+}
+
+// Multithreaded LSD radix sort of 32 bit keys with 32 bit values, four stable passes of 8 bits.
+// Every pass counts digits per chunk, prefix sums the counts in chunk order and scatters the chunks in parallel.
+class RadixSort
+{
+public:
+	RadixSort(WorkerPool& workers);
+
+	// Sorts the first count keys ascending and moves the values along. The vectors may be swapped with
+	// internal scratch storage, so they must hold at least count elements and nothing else should point into them.
+	void Sort(std::vector<uint32_t>& keys, std::vector<uint32_t>& values, unsigned int count);
+
+	// Prints sort times for the given counts of random keys, single threaded and with all threads
+	static void Benchmark(const std::vector<unsigned int>& counts, unsigned int repetitions);
+
+private:
+	WorkerPool& mWorkers;
+	std::vector<uint32_t> mKeys;
+	std::vector<uint32_t> mValues;
+	// 256 digit counts per chunk, turned into output offsets in place
+	std::vector<unsigned int> mHistograms;
+};
@@ -43,6 +43,10 @@ Shader::Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const char*
     {
         std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
     }
+    vertexCode = resolveIncludes(vertexCode, vertexPath);
+    fragmentCode = resolveIncludes(fragmentCode, fragmentPath);
+    if (geometryPath != nullptr)
+        geometryCode = resolveIncludes(geometryCode, geometryPath);
     const char* vShaderCode = vertexCode.c_str();
     const char* fShaderCode = fragmentCode.c_str();
     // 2. compile shaders
@@ -87,7 +91,7 @@ Shader::Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const char*
         glDeleteShader(geometry);
 }
 
-Shader::Shader(const GLchar* computePath)
+Shader::Shader(const GLchar* computePath, const std::string& defines)
 {
     // 1. retrieve the source code from filePath
     std::string computeCode;
@@ -110,6 +114,15 @@ Shader::Shader(const GLchar* computePath)
     {
         std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
     }
+    computeCode = resolveIncludes(computeCode, computePath);
+    if (!defines.empty())
+    {
+        // #version has to stay the first statement
+        size_t version = computeCode.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : computeCode.find('\n', version);
+        size_t insert = lineEnd == std::string::npos ? 0 : lineEnd + 1;
+        computeCode.insert(insert, defines);
+    }
     const char* cShaderCode = computeCode.c_str();
     // 2. compile shaders
     unsigned int compute;
@@ -166,6 +179,43 @@ void Shader::setMat4(const std::string& name, glm::mat4 value) const
     glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, value_ptr(value));
 }
 
+std::string Shader::resolveIncludes(const std::string& code, const std::string& path, int depth)
+{
+    // guards against files including each other
+    if (depth > 8)
+    {
+        std::cout << "ERROR::SHADER::INCLUDE_TOO_DEEP: " << path << std::endl;
+        return code;
+    }
+
+    std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+    std::stringstream in(code);
+    std::stringstream out;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        size_t directive = line.find("#include");
+        size_t open = line.find('"', directive);
+        size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+        if (directive == std::string::npos || line.find_first_not_of(" \t") != directive || close == std::string::npos)
+        {
+            out << line << "\n";
+            continue;
+        }
+
+        std::string includePath = directory + line.substr(open + 1, close - open - 1);
+        std::ifstream includeFile(includePath);
+        if (!includeFile)
+        {
+            std::cout << "ERROR::SHADER::INCLUDE_NOT_FOUND: " << includePath << std::endl;
+            continue;
+        }
+        std::stringstream includeStream;
+        includeStream << includeFile.rdbuf();
+        out << resolveIncludes(includeStream.str(), includePath, depth + 1) << "\n";
+    }
+    return out.str();
+}
 
 // utility function for checking shader compilation/linking errors.
 // ------------------------------------------------------------------------
@@ -20,7 +20,8 @@ public:
 
 	// constructor reads and builds the shader
 	Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const char* geometryPath = nullptr, const char* transformFeedbackOutVar[] = nullptr, const unsigned int varAmount = 0);
-	Shader(const GLchar* computePath);
+	// defines are inserted after the #version line, one "#define NAME VALUE" per line
+	Shader(const GLchar* computePath, const std::string& defines = "");
 	~Shader();
 
 	void create(const GLchar* vertexPath, const GLchar* fragmentPath);
@@ -36,6 +37,8 @@ public:
 
 private:
 	void checkCompileErrors(GLuint shader, std::string type);
+	// replaces #include "file" lines with the file, paths are relative to the including shader
+	static std::string resolveIncludes(const std::string& code, const std::string& path, int depth = 0);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,27 @@
+#version 430
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 8) in;
+layout(r16f, binding = 0) uniform image3D densityImage;
+
+// Sparse density deltas of a sector, one 8x8x8 brick per work group
+struct DensityBrick
+{
+    ivec4 origin;
+    float delta[512];
+};
+
+layout(std430, binding = 0) readonly buffer BrickBuffer
+{
+    DensityBrick bricks[];
+};
+
+void main()
+{
+    uint brick = gl_WorkGroupID.x;
+    ivec3 voxel = bricks[brick].origin.xyz + ivec3(gl_LocalInvocationID);
+    if (any(greaterThanEqual(voxel, imageSize(densityImage))))
+        return;
+
+    // local invocation index is x fastest, same as the delta layout
+    float density = imageLoad(densityImage, voxel).x + bricks[brick].delta[gl_LocalInvocationIndex];
+    imageStore(densityImage, voxel, vec4(density, 0, 0, 1));
+}
@@ -22,6 +22,8 @@ uniform mat4 projection;
 uniform mat4 view;
 uniform mat4 model;
 uniform vec3 viewPos;
+// fractional texture space offset of the floating origin, keeps the projection continuous when the origin moves
+uniform float textureOrigin;
 
 float g_initialStepIterations = 3;
 float g_refinementStepIterations = 1;
@@ -112,8 +114,8 @@ void main()
 
 
     //triplanar projection coords
-    vec2 xCoord = gs_in.wsCoord.yz * TEXTURE_SCALE;
-    vec2 yCoord = gs_in.wsCoord.xz * TEXTURE_SCALE;
+    vec2 xCoord = gs_in.wsCoord.yz * TEXTURE_SCALE + vec2(0, textureOrigin);
+    vec2 yCoord = gs_in.wsCoord.xz * TEXTURE_SCALE + vec2(0, textureOrigin);
     vec2 zCoord = gs_in.wsCoord.xy * TEXTURE_SCALE;
 
 
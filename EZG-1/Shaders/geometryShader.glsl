@@ -171,9 +171,10 @@ vec3 calculateVertexNormal(vec3 p1, vec3 p2, vec3 p3)
 void setupVertex(vec3 pos_within_cell, vec3 normal)
 {
     vec3 vecWsCoord = gs_in[0].wsCoord.xyz + pos_within_cell.xyz;// * wsVoxelSize;
-    gl_Position = projection * view * model * vec4(vecWsCoord, 1);
+    vec4 originCoord = model * vec4(vecWsCoord, 1);
+    gl_Position = projection * view * originCoord;
     vec3 uvw = gs_in[0].uvw + (pos_within_cell * inv_voxelDimMinusOne.xyz).xyz;
-    gs_out.wsCoord = vecWsCoord;
+    gs_out.wsCoord = originCoord.xyz;
     gs_out.wsNormal = calculateSurfaceNormal(uvw);
 }
 
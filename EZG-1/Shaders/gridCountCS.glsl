@@ -0,0 +1,41 @@
+#version 430 core
+layout(local_size_x = 256) in;
+
+#include "particlePacking.glsl"
+
+layout(std430, binding = 0) readonly buffer ParticleBuffer { uvec4 particles[]; };
+layout(std430, binding = 2) readonly buffer AliveList { uint aliveList[]; };
+layout(std430, binding = 4) readonly buffer Counters
+{
+    int deadCount;
+    uint aliveCount;
+    uint nextAliveCount;
+    uint requestCount;
+    uint overflowCount;
+};
+layout(std430, binding = 9) buffer CellStarts { uint cellStarts[]; };
+layout(std430, binding = 11) writeonly buffer ParticleCells { uvec2 particleCells[]; };
+
+uniform float cellSize;
+uniform int tableMask;
+// origin the particle positions are packed relative to
+uniform vec3 origin;
+
+// Same hash as SpatialHashCell in SpatialHash.h
+uint hashCell(ivec3 cell)
+{
+    uvec3 u = uvec3(cell);
+    return (u.x * 73856093u ^ u.y * 19349663u ^ u.z * 83492791u) & uint(tableMask);
+}
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= aliveCount)
+        return;
+
+    vec3 position = unpackPosition(particles[aliveList[index]], origin);
+    uint hash = hashCell(ivec3(floor(position / cellSize)));
+    // the count before the add is the particle's place inside its slot
+    particleCells[index] = uvec2(hash, atomicAdd(cellStarts[hash], 1u));
+}
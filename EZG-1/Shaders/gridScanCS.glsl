@@ -0,0 +1,59 @@
+#version 430 core
+layout(local_size_x = 1024) in;
+
+// CELL_START_BINDING in GpuSpatialHash.h
+layout(std430, binding = 9) buffer CellStarts { uint cellStart[]; };
+// one total per work group, scanned by radixScanCS.glsl in between the two passes
+layout(std430, binding = 4) buffer BlockSums { uint blockSums[]; };
+
+// GRID_SCAN_BLOCK_SIZE in GpuSpatialHash.cpp
+#define ITEMS 4
+#define BLOCK_SIZE (1024 * ITEMS)
+
+// hash slots plus the one start that ends the last slot
+uniform int size;
+// first pass scans every block on its own, the second one adds the scanned totals of the blocks before it
+uniform bool addBlockSums;
+
+shared uint sums[1024];
+
+// Exclusive prefix sum of the slot counts in blocks of BLOCK_SIZE, one work group per block, so the whole
+// GPU shares the table instead of a single work group walking it
+void main()
+{
+    uint local = gl_LocalInvocationID.x;
+    uint begin = gl_WorkGroupID.x * BLOCK_SIZE + local * ITEMS;
+
+    if (addBlockSums) {
+        uint offset = blockSums[gl_WorkGroupID.x];
+        for (uint i = 0u; i < ITEMS; ++i)
+            if (begin + i < uint(size))
+                cellStart[begin + i] += offset;
+        return;
+    }
+
+    uint values[ITEMS];
+    uint total = 0u;
+    for (uint i = 0u; i < ITEMS; ++i) {
+        values[i] = begin + i < uint(size) ? cellStart[begin + i] : 0u;
+        total += values[i];
+    }
+
+    sums[local] = total;
+    barrier();
+    for (uint offset = 1u; offset < 1024u; offset <<= 1) {
+        uint value = local >= offset ? sums[local - offset] : 0u;
+        barrier();
+        sums[local] += value;
+        barrier();
+    }
+
+    uint running = sums[local] - total;
+    for (uint i = 0u; i < ITEMS; ++i) {
+        if (begin + i < uint(size))
+            cellStart[begin + i] = running;
+        running += values[i];
+    }
+    if (local == 1023u)
+        blockSums[gl_WorkGroupID.x] = sums[local];
+}
@@ -0,0 +1,33 @@
+#version 430 core
+layout(local_size_x = 256) in;
+
+#include "particlePacking.glsl"
+
+layout(std430, binding = 0) readonly buffer ParticleBuffer { uvec4 particles[]; };
+layout(std430, binding = 2) readonly buffer AliveList { uint aliveList[]; };
+layout(std430, binding = 4) readonly buffer Counters
+{
+    int deadCount;
+    uint aliveCount;
+    uint nextAliveCount;
+    uint requestCount;
+    uint overflowCount;
+};
+layout(std430, binding = 9) readonly buffer CellStarts { uint cellStarts[]; };
+layout(std430, binding = 10) writeonly buffer Entries { vec4 entries[]; };
+layout(std430, binding = 11) readonly buffer ParticleCells { uvec2 particleCells[]; };
+
+// origin the particle positions are packed relative to
+uniform vec3 origin;
+
+// Copies position and slot of every alive particle into cell order, neighbour queries read them contiguously
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= aliveCount)
+        return;
+
+    uint slot = aliveList[index];
+    uvec2 cell = particleCells[index];
+    entries[cellStarts[cell.x] + cell.y] = vec4(unpackPosition(particles[slot], origin), uintBitsToFloat(slot));
+}
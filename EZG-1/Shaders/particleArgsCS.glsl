@@ -0,0 +1,67 @@
+#version 430 core
+layout(local_size_x = 1) in;
+
+layout(std430, binding = 4) buffer Counters
+{
+    int deadCount;
+    uint aliveCount;
+    uint nextAliveCount;
+    uint requestCount;
+    uint overflowCount;
+    uint visibleCount;
+};
+
+layout(std430, binding = 6) buffer IndirectArgs
+{
+    // plain arrays, a uvec3 would be padded to 16 bytes
+    uint simulateGroups[3];
+    uint emitGroups[3];
+    uint drawCount;
+    uint drawInstanceCount;
+    uint drawFirst;
+    uint drawBaseInstance;
+    uint quadVertexCount;
+    uint quadInstanceCount;
+    uint quadFirst;
+    uint quadBaseInstance;
+};
+
+// 0: after simulation, sizes the emit dispatch
+// 1: after emission, swaps the alive lists and sizes the next simulation and the draw
+uniform int stage;
+// draw the culled visible list instead of every alive particle
+uniform bool culling;
+// spawn commands of the CPU, emitted after the requests of the simulation
+uniform int commandCount;
+
+#define SIMULATE_GROUP_SIZE 256u
+#define EMIT_GROUP_SIZE 64u
+#define MAX_EMIT_REQUESTS 4096u
+
+void main()
+{
+    if (stage == 0) {
+        uint requests = min(requestCount, MAX_EMIT_REQUESTS) + uint(commandCount);
+        emitGroups[0] = (requests + EMIT_GROUP_SIZE - 1u) / EMIT_GROUP_SIZE;
+        emitGroups[1] = 1u;
+        emitGroups[2] = 1u;
+    }
+    else {
+        aliveCount = nextAliveCount;
+        nextAliveCount = 0u;
+        requestCount = 0u;
+        simulateGroups[0] = (aliveCount + SIMULATE_GROUP_SIZE - 1u) / SIMULATE_GROUP_SIZE;
+        simulateGroups[1] = 1u;
+        simulateGroups[2] = 1u;
+        drawCount = culling ? visibleCount : aliveCount;
+        visibleCount = 0u;
+        drawInstanceCount = 1u;
+        drawFirst = 0u;
+        drawBaseInstance = 0u;
+        // the same particles as instanced billboards
+        quadVertexCount = 4u;
+        quadInstanceCount = drawCount;
+        quadFirst = 0u;
+        quadBaseInstance = 0u;
+    }
+}
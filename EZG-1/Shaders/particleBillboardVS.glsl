@@ -0,0 +1,49 @@
+#version 430 core
+
+#include "particlePacking.glsl"
+
+// either 4 words of the packed compute pipeline layout or 8 floats of the transform feedback particlestruct
+layout(std430, binding = 0) readonly buffer ParticleBuffer { uint particleData[]; };
+layout(std430, binding = 2) readonly buffer DrawList { uint drawList[]; };
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+// instances index drawList instead of the particle buffer
+uniform bool drawListed;
+// view space half size of the quads
+uniform float particleSize;
+// packed particles and the origin their positions are relative to
+uniform bool packedParticles;
+uniform vec3 origin;
+
+// same block as the particleRenderGS.glsl output, so both paths share particleRenderPS.glsl
+out GS_Out{
+    vec4 fColor;
+    vec2 texCoord;
+    float viewDepth;
+} vs_out;
+
+// One instance per particle, drawn as a 4 vertex triangle strip expanded around the particle in view space
+void main() {
+    uint particle = drawListed ? drawList[gl_InstanceID] : uint(gl_InstanceID);
+    vec3 position;
+    if (packedParticles) {
+        uint base = particle * 4u;
+        position = unpackPosition(uvec4(particleData[base], particleData[base + 1u], particleData[base + 2u], particleData[base + 3u]), origin);
+    }
+    else {
+        uint base = particle * 8u;
+        position = uintBitsToFloat(uvec3(particleData[base], particleData[base + 1u], particleData[base + 2u]));
+    }
+
+    // bottom-left, bottom-right, top-left, top-right like particleRenderGS.glsl
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    vs_out.texCoord = corner;
+    vs_out.fColor = vec4(1, 1, 1, 1);
+
+    vec4 viewPosition = view * model * vec4(position, 1.0);
+    viewPosition.xy += (corner * 2.0 - 1.0) * particleSize;
+    vs_out.viewDepth = -viewPosition.z;
+    gl_Position = projection * viewPosition;
+}
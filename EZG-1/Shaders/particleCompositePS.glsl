@@ -0,0 +1,26 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// weighted premultiplied colour in rgb and weighted alpha in a, summed over the particles of the pixel
+uniform sampler2D accumulation;
+// product of 1 - alpha over the particles of the pixel
+uniform sampler2D revealage;
+
+// Composite of the weighted blended OIT targets, see ParticleTransparency.h
+void main()
+{
+    float reveal = texture(revealage, TexCoords).r;
+    // nothing was drawn here
+    if (reveal >= 1.0)
+        discard;
+
+    vec4 accum = texture(accumulation, TexCoords);
+    // sixteen bit floats overflow to infinity under heavy overdraw
+    if (isinf(max(max(abs(accum.r), abs(accum.g)), abs(accum.b))))
+        accum.rgb = vec3(accum.a);
+
+    vec3 averageColor = accum.rgb / max(accum.a, 1e-5);
+    FragColor = vec4(averageColor, 1.0 - reveal);
+}
@@ -0,0 +1,27 @@
+#version 430 core
+layout(location = 0) out float LinearDepth;
+
+in vec2 TexCoords;
+
+// copy of the full resolution scene depth
+layout(binding = 0) uniform sampler2D sceneDepth;
+// size of a block of full resolution pixels per low resolution pixel
+uniform int divisor;
+uniform float nearPlane;
+uniform float farPlane;
+
+// Nearest scene depth of a divisor x divisor block, see ParticleTransparency.h. The nearest depth keeps the
+// particles behind a thin foreground edge hidden, the average would let them show through at its border.
+void main()
+{
+    ivec2 size = textureSize(sceneDepth, 0);
+    ivec2 origin = ivec2(gl_FragCoord.xy) * divisor;
+    float depth = 1.0;
+    for (int y = 0; y < divisor; ++y)
+        for (int x = 0; x < divisor; ++x)
+            depth = min(depth, texelFetch(sceneDepth, min(origin + ivec2(x, y), size - 1), 0).r);
+
+    gl_FragDepth = depth;
+    float ndc = depth * 2.0 - 1.0;
+    LinearDepth = 2.0 * nearPlane * farPlane / (farPlane + nearPlane - ndc * (farPlane - nearPlane));
+}
@@ -0,0 +1,132 @@
+#version 430 core
+layout(local_size_x = 64) in;
+
+#include "particlePacking.glsl"
+#include "particleRandom.glsl"
+#include "surfaceSampling.glsl"
+
+// Same layout as SpawnCommand in ComputeParticles.h
+struct EmitRequest
+{
+    vec3 position;
+    float type;
+    uint count;
+    // keys the spawn velocities, the slot of the emitting particle for requests from the simulation
+    uint emitter;
+    // TYPE_A: scale of the random spawn velocity and the lifetime the particles start at
+    float speed;
+    float lifeTime;
+};
+
+layout(std430, binding = 0) writeonly buffer ParticleBuffer { uvec4 particles[]; };
+layout(std430, binding = 1) buffer DeadList { uint deadList[]; };
+layout(std430, binding = 3) writeonly buffer NextAliveList { uint nextAliveList[]; };
+layout(std430, binding = 4) buffer Counters
+{
+    int deadCount;
+    uint aliveCount;
+    uint nextAliveCount;
+    uint requestCount;
+    uint overflowCount;
+    uint visibleCount;
+};
+layout(std430, binding = 5) readonly buffer EmitRequests { EmitRequest requests[]; };
+// spawn commands the CPU queued for this update, a range of the spawn ring
+layout(std430, binding = 13) readonly buffer SpawnCommands { EmitRequest commands[]; };
+layout(std430, binding = 12) writeonly buffer VisibleList { uint visibleList[]; };
+
+#define EMITTER 1.0f
+#define TYPE_A 2.0f
+
+#define MAX_EMIT_REQUESTS 4096u
+// spawn commands with this emitter bit take their positions from the emission surface
+#define SURFACE_EMITTER 0x40000000u
+
+// updates since the last reset
+uniform int frame;
+// origin the particles of this update are packed relative to
+uniform vec3 packOrigin;
+uniform int commandCount;
+
+// culling of the draw list, clip space includes the model transform
+uniform bool culling;
+uniform mat4 cullMatrix;
+// clip space half size of the billboards in particleRenderGS.glsl
+uniform float billboardSize;
+// particles smaller than this on screen are not drawn
+uniform float minPixelSize;
+uniform float viewportHeight;
+
+// Frustum test of the billboard in clip space, the same as testing against the planes of cullMatrix
+// pushed out by the billboard size, followed by the projected size test
+bool isVisible(vec3 position)
+{
+    vec4 clip = cullMatrix * vec4(position, 1);
+    if (clip.w <= 0 || abs(clip.z) > clip.w)
+        return false;
+    if (abs(clip.x) > clip.w + billboardSize || abs(clip.y) > clip.w + billboardSize)
+        return false;
+    return billboardSize / clip.w * viewportHeight >= minPixelSize;
+}
+
+void addToDrawList(uint slot, vec3 position)
+{
+    if (culling && isVisible(position))
+        visibleList[atomicAdd(visibleCount, 1u)] = slot;
+}
+
+// Pops a free slot from the dead list, returns false when the pool is exhausted
+bool allocate(out uint slot)
+{
+    int top = atomicAdd(deadCount, -1) - 1;
+    if (top < 0) {
+        atomicAdd(deadCount, 1);
+        return false;
+    }
+    slot = deadList[top];
+    return true;
+}
+
+// One invocation per emit request of the simulation, followed by one per spawn command of the CPU
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    uint requestTotal = min(requestCount, MAX_EMIT_REQUESTS);
+    if (index >= requestTotal + uint(commandCount))
+        return;
+
+    EmitRequest request = index < requestTotal ? requests[index] : commands[index - requestTotal];
+    vec3 position = request.position;
+    float type = request.type;
+    int amount = int(request.count);
+    uint emitter = request.emitter;
+    bool onSurface = (emitter & SURFACE_EMITTER) != 0u && index >= requestTotal;
+    if (onSurface && surfaceTriangleCount == 0)
+        return;
+
+    for (int i = 0; i < amount; ++i) {
+        uint slot;
+        if (!allocate(slot)) {
+            // the pool is full, count the rest of the request as overflow
+            atomicAdd(overflowCount, uint(amount - i));
+            return;
+        }
+
+        ParticleState particle;
+        particle.position = onSurface ? sampleSurface(randomKey(uint(frame), emitter, uint(i))) : position;
+        particle.type = type;
+        particle.flags = 0u;
+        if (type == EMITTER) {
+            // same initial state as spawnEmitter in particleTransformGS.glsl
+            particle.velocity = vec3(position.y, 0, 0);
+            particle.lifeTime = position.x;
+        }
+        else {
+            particle.velocity = spawnVelocity(uint(frame), emitter, uint(i)) * request.speed;
+            particle.lifeTime = request.lifeTime;
+        }
+        particles[slot] = packParticle(particle, packOrigin);
+        nextAliveList[atomicAdd(nextAliveCount, 1u)] = slot;
+        addToDrawList(slot, particle.position);
+    }
+}
@@ -0,0 +1,72 @@
+// 16 byte particle state of the compute pipeline, the same packing as PackedParticle.h.
+// Include after the #version line.
+//   x: position.x, position.y   y: position.z, velocity.x   z: velocity.y, velocity.z   w: lifeTime | type << 16 | flags << 24
+
+#define PACKED_MAX_LIFETIME 16.0
+
+struct ParticleState
+{
+    vec3 position;
+    vec3 velocity;
+    float lifeTime;
+    float type;
+    uint flags;
+};
+
+// Only the position, for passes that do not need the rest
+vec3 unpackPosition(uvec4 packed, vec3 origin)
+{
+    return vec3(unpackHalf2x16(packed.x), unpackHalf2x16(packed.y).x) + origin;
+}
+
+ParticleState unpackParticle(uvec4 packed, vec3 origin)
+{
+    vec2 zw = unpackHalf2x16(packed.y);
+    vec2 yz = unpackHalf2x16(packed.z);
+
+    ParticleState particle;
+    particle.position = vec3(unpackHalf2x16(packed.x), zw.x) + origin;
+    particle.velocity = vec3(zw.y, yz);
+    particle.lifeTime = float(packed.w & 0xFFFFu) / 65535.0 * PACKED_MAX_LIFETIME;
+    particle.type = float((packed.w >> 16) & 0xFFu);
+    particle.flags = packed.w >> 24;
+    return particle;
+}
+
+// Half float bits of value, rounded up or down at random with the probability that makes value the expected
+// result. Round to nearest swallows every step below half a half float ulp, 0.016 at 32 to 64 units from the
+// origin, so slow particles far from the camera would freeze. Values a half holds exactly stay exact.
+uint ditheredHalf(float value, float random)
+{
+    uint nearest = packHalf2x16(vec2(value, 0.0)) & 0xFFFFu;
+    float rounded = unpackHalf2x16(nearest).x;
+    if (rounded == value)
+        return nearest;
+    // sign and magnitude, one more is the next half away from zero
+    uint other = abs(value) > abs(rounded) ? nearest + 1u : nearest - 1u;
+    float otherValue = unpackHalf2x16(other).x;
+    return random < (value - rounded) / (otherValue - rounded) ? other : nearest;
+}
+
+uvec4 packParticle(ParticleState particle, vec3 origin)
+{
+    vec3 position = particle.position - origin;
+    float lifeTime = clamp(particle.lifeTime / PACKED_MAX_LIFETIME, 0.0, 1.0);
+    return uvec4(
+        packHalf2x16(position.xy),
+        packHalf2x16(vec2(position.z, particle.velocity.x)),
+        packHalf2x16(particle.velocity.yz),
+        uint(floor(lifeTime * 65535.0 + 0.5)) | (uint(particle.type) & 0xFFu) << 16 | (particle.flags & 0xFFu) << 24);
+}
+
+// packParticle with the position rounded by ditheredHalf, for particles that are repacked every update.
+// random holds three uniform numbers in [0, 1). Moving particles jitter by up to one half ulp, 0.03 units at
+// 32 to 64 units from the origin and twice that per further doubling, positions beyond 65504 units overflow.
+uvec4 packParticleDithered(ParticleState particle, vec3 origin, vec3 random)
+{
+    uvec4 packed = packParticle(particle, origin);
+    vec3 position = particle.position - origin;
+    packed.x = ditheredHalf(position.x, random.x) | ditheredHalf(position.y, random.y) << 16;
+    packed.y = ditheredHalf(position.z, random.z) | (packed.y & 0xFFFF0000u);
+    return packed;
+}
@@ -0,0 +1,25 @@
+#version 430 core
+
+#include "particlePacking.glsl"
+
+layout(std430, binding = 0) readonly buffer ParticleBuffer { uvec4 particles[]; };
+layout(std430, binding = 2) readonly buffer AliveList { uint aliveList[]; };
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+// origin the particle positions are packed relative to
+uniform vec3 origin;
+
+out VS_OUT{
+	vec3 velocity;
+	float type;
+} vs_out;
+
+// Same output as particleRenderVS.glsl, but the particle is pulled from the alive list
+void main() {
+	ParticleState particle = unpackParticle(particles[aliveList[gl_VertexID]], origin);
+	vs_out.velocity = particle.velocity;
+	vs_out.type = particle.type;
+	gl_Position = projection * view * model * vec4(particle.position, 1.f);
+}
@@ -0,0 +1,38 @@
+// Stateless counter based random numbers, the same functions as ParticleRandom.h.
+// Include after the #version line.
+
+// PCG hash, one round of the PCG RXS M XS generator on the input
+uint pcgHash(uint value)
+{
+    uint state = value * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// Key of the index-th particle spawned by an emitter in an update
+uint randomKey(uint frame, uint emitter, uint index)
+{
+    return pcgHash(index ^ pcgHash(emitter ^ pcgHash(frame)));
+}
+
+// Uniform float in [0, 1) from the upper 24 bits, exactly representable so both sides agree bit for bit
+float randomFloat(uint bits)
+{
+    return float(bits >> 8u) * (1.0 / 16777216.0);
+}
+
+// Three uniform floats in [0, 1), the key is hashed once per component
+vec3 randomVec3(uint key)
+{
+    uint x = pcgHash(key);
+    uint y = pcgHash(x);
+    uint z = pcgHash(y);
+    return vec3(randomFloat(x), randomFloat(y), randomFloat(z));
+}
+
+// Initial velocity of a TYPE_A particle, SpawnVelocity in Particles.h
+vec3 spawnVelocity(uint frame, uint emitter, uint index)
+{
+    vec3 r = randomVec3(randomKey(frame, emitter, index));
+    return vec3(r.x * 2.0 - 1.0, r.y, r.z * 2.0 - 1.0) * 10.0;
+}
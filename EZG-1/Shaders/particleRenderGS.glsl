@@ -12,37 +12,42 @@ out GS_Out{
 	// .xyz = wsCoord, .w = occlusion
 		vec4 fColor;
 		vec2 texCoord;
+		// distance along the view direction, for the soft particle fade
+		float viewDepth;
 } gs_out;
 
 float size = 3.f;
 
-void buildParticle(vec4 position)
+// Every output is undefined after EmitVertex, so all of them are written for every corner
+void emitCorner(vec4 position, vec4 color, vec2 corner)
 {
-	gs_out.texCoord = vec2(0.0, 0.0);
-	gl_Position = position + vec4(-0.2, -0.2, 0.0, 0.0) * size;    // 1:bottom-left
-	EmitVertex();
-	gs_out.texCoord = vec2(1.0, 0.0);
-	gl_Position = position + vec4(0.2, -0.2, 0.0, 0.0) * size;    // 2:bottom-right
-	EmitVertex();
-	gs_out.texCoord = vec2(0.0, 1.0);
-	gl_Position = position + vec4(-0.2, 0.2, 0.0, 0.0) * size;    // 3:top-left
-	EmitVertex();
-	gs_out.texCoord = vec2(1.0, 1.0);
-	gl_Position = position + vec4(0.2, 0.2, 0.0, 0.0) * size;    // 4:top-right
+	gs_out.fColor = color;
+	gs_out.texCoord = corner;
+	gs_out.viewDepth = position.w;
+	gl_Position = position + vec4(corner * 0.4 - 0.2, 0.0, 0.0) * size;
 	EmitVertex();
+}
+
+void buildParticle(vec4 position, vec4 color)
+{
+	emitCorner(position, color, vec2(0.0, 0.0));    // 1:bottom-left
+	emitCorner(position, color, vec2(1.0, 0.0));    // 2:bottom-right
+	emitCorner(position, color, vec2(0.0, 1.0));    // 3:top-left
+	emitCorner(position, color, vec2(1.0, 1.0));    // 4:top-right
 	EndPrimitive();
 }
 
 void main() {
 
+	vec4 color;
 	if (gs_in[0].type == 1.0f)
-		gs_out.fColor = vec4(0, 1, 0, 1);
+		color = vec4(0, 1, 0, 1);
 	if (gs_in[0].type == 2.0f)
-		gs_out.fColor = vec4(1, 1, 1, 1);
+		color = vec4(1, 1, 1, 1);
 	if (gs_in[0].type == 3.0f)
-		gs_out.fColor = vec4(0, 0, 1, 1);
+		color = vec4(0, 0, 1, 1);
 
-	gs_out.fColor = vec4(1, 1, 1, 1);
+	color = vec4(1, 1, 1, 1);
 	//if(gs_in[0].type != 0.0f)
-	buildParticle(gl_in[0].gl_Position);
+	buildParticle(gl_in[0].gl_Position, color);
 }
\ No newline at end of file
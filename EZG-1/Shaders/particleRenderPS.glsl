@@ -1,13 +1,59 @@
-#version 330 core
+#version 430 core
 
 in GS_Out{
     vec4 fColor;
     vec2 texCoord;
+    float viewDepth;
 } gs_in;
 
-out vec4 FragColor;
+layout(location = 0) out vec4 FragColor;
+// transmittance target of the weighted blended mode, not drawn otherwise
+layout(location = 1) out float Revealage;
+
+// ParticleBlendMode in ParticleTransparency.h
+#define BLEND_OPAQUE 0
+#define BLEND_ALPHA 1
+#define BLEND_WEIGHTED 2
+#define BLEND_SOFT 3
+uniform int blendMode;
+// opacity of the sprite center, fading out towards the edge
+uniform float opacity;
+
+// soft mode: linear scene depth at the resolution drawn to and the mist sprite
+layout(binding = 2) uniform sampler2D sceneLinearDepth;
+layout(binding = 3) uniform sampler2D sprite;
+// view space distance over which a particle fades out in front of the scene
+#define SOFT_DISTANCE 1.0
 
 void main()
 {
-    FragColor = vec4(gs_in.fColor);
-}
\ No newline at end of file
+    if (blendMode == BLEND_OPAQUE) {
+        FragColor = vec4(gs_in.fColor);
+        return;
+    }
+
+    if (blendMode == BLEND_SOFT) {
+        float fade = clamp((texelFetch(sceneLinearDepth, ivec2(gl_FragCoord.xy), 0).r - gs_in.viewDepth) / SOFT_DISTANCE, 0.0, 1.0);
+        float alpha = gs_in.fColor.a * opacity * texture(sprite, gs_in.texCoord).r * fade;
+        if (alpha <= 0.0)
+            discard;
+        FragColor = vec4(gs_in.fColor.rgb * alpha, alpha);
+        return;
+    }
+
+    vec2 offset = gs_in.texCoord * 2.0 - 1.0;
+    float alpha = gs_in.fColor.a * opacity * max(0.0, 1.0 - dot(offset, offset));
+    if (alpha <= 0.0)
+        discard;
+
+    if (blendMode == BLEND_ALPHA) {
+        FragColor = vec4(gs_in.fColor.rgb, alpha);
+        return;
+    }
+
+    // depth weight of McGuire and Bavoil, favours the particles close to the camera
+    float z = gl_FragCoord.z;
+    float weight = clamp(pow(min(1.0, alpha * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - z * 0.9, 3.0), 1e-2, 3e3);
+    FragColor = vec4(gs_in.fColor.rgb * alpha, alpha) * weight;
+    Revealage = alpha;
+}
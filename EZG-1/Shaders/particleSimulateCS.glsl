@@ -0,0 +1,328 @@
+#version 430 core
+layout(local_size_x = 256) in;
+
+#include "particlePacking.glsl"
+#include "particleRandom.glsl"
+
+// Same layout as SpawnCommand in ComputeParticles.h
+struct EmitRequest
+{
+    vec3 position;
+    float type;
+    uint count;
+    // keys the spawn velocities, the slot of the emitting particle for requests from the simulation
+    uint emitter;
+    // TYPE_A: scale of the random spawn velocity and the lifetime the particles start at
+    float speed;
+    float lifeTime;
+};
+
+layout(std430, binding = 0) buffer ParticleBuffer { uvec4 particles[]; };
+layout(std430, binding = 1) buffer DeadList { uint deadList[]; };
+layout(std430, binding = 2) readonly buffer AliveList { uint aliveList[]; };
+layout(std430, binding = 3) writeonly buffer NextAliveList { uint nextAliveList[]; };
+layout(std430, binding = 4) buffer Counters
+{
+    int deadCount;
+    uint aliveCount;
+    uint nextAliveCount;
+    uint requestCount;
+    uint overflowCount;
+    uint visibleCount;
+    uint traillessCount;
+};
+layout(std430, binding = 5) writeonly buffer EmitRequests { EmitRequest requests[]; };
+layout(std430, binding = 9) readonly buffer CellStarts { uint cellStarts[]; };
+layout(std430, binding = 10) readonly buffer Entries { vec4 entries[]; };
+layout(std430, binding = 12) writeonly buffer VisibleList { uint visibleList[]; };
+
+// Same layout as TrailHeader in ParticleTrails.cpp
+struct TrailHeader
+{
+    uint owner;
+    uint head;
+    uint count;
+    float timer;
+};
+
+layout(std430, binding = 16) buffer TrailHeaders { TrailHeader trailHeaders[]; };
+layout(std430, binding = 17) writeonly buffer TrailPoints { vec4 trailPoints[]; };
+
+uniform float deltaTime;
+uniform bool spawnNewEmitter;
+uniform vec3 spawnPosition;
+// particles are read relative to the origin of the last update and written relative to the new one
+uniform vec3 unpackOrigin;
+uniform vec3 packOrigin;
+// keys the position dithering of packParticleDithered
+uniform int frame;
+
+// particle interaction, see ParticleInteraction in SpatialHash.h
+uniform bool interaction;
+uniform float cellSize;
+uniform int tableMask;
+uniform float repulsionRadius;
+uniform float repulsionStrength;
+uniform int maxNeighbours;
+uniform float restitution;
+
+// terrain density in sector local voxel space, positive is solid
+uniform bool terrainCollision;
+layout(binding = 0) uniform sampler3D terrainDensity;
+uniform vec3 terrainDimensions;
+
+// curl noise force field baked by ForceField.cpp, repeats every turbulenceTileSize world units
+uniform bool turbulence;
+layout(binding = 1) uniform sampler3D turbulenceField;
+uniform float turbulenceStrength;
+uniform float turbulenceTileSize;
+// how far the field has scrolled since the last reset
+uniform vec3 turbulenceOffset;
+
+// emitter trails, see ParticleTrails.h
+uniform bool trails;
+uniform int trailCount;
+uniform int trailLength;
+uniform float trailInterval;
+// speed the emitters wander with along the force field, 0 without a field
+uniform float emitterDrift;
+
+// culling of the draw list, clip space includes the model transform
+uniform bool culling;
+uniform mat4 cullMatrix;
+// clip space half size of the billboards in particleRenderGS.glsl
+uniform float billboardSize;
+// particles smaller than this on screen are not drawn
+uniform float minPixelSize;
+uniform float viewportHeight;
+
+#define PRIMARY_EMITTER 0.0f
+#define EMITTER 1.0f
+#define TYPE_A 2.0f
+#define TYPE_B 3.0f
+
+#define MAX_EMIT_REQUESTS 4096u
+
+void requestEmit(vec3 position, float type, int amount, uint emitter)
+{
+    uint request = atomicAdd(requestCount, 1u);
+    if (request < MAX_EMIT_REQUESTS)
+    {
+        requests[request] = EmitRequest(position, type, uint(amount), emitter, 1.0, 0.0);
+    }
+    else {
+        atomicAdd(overflowCount, uint(amount));
+    }
+}
+
+// Same hash as SpatialHashCell in SpatialHash.h
+uint hashCell(ivec3 cell)
+{
+    uvec3 u = uvec3(cell);
+    return (u.x * 73856093u ^ u.y * 19349663u ^ u.z * 83492791u) & uint(tableMask);
+}
+
+// Push away from the particles closer than repulsionRadius, taken from the grid built before this pass
+vec3 repulsion(vec3 position, uint slot)
+{
+    vec3 push = vec3(0);
+    int neighbours = 0;
+    ivec3 center = ivec3(floor(position / cellSize));
+    // cells of the neighbourhood can share a hash slot, its particles are only visited once
+    uint visited[27];
+    int visitedCount = 0;
+    for (int z = -1; z <= 1; ++z)
+    for (int y = -1; y <= 1; ++y)
+    for (int x = -1; x <= 1; ++x) {
+        uint hash = hashCell(center + ivec3(x, y, z));
+        bool seen = false;
+        for (int v = 0; v < visitedCount; ++v)
+            seen = seen || visited[v] == hash;
+        if (seen)
+            continue;
+        visited[visitedCount++] = hash;
+        for (uint i = cellStarts[hash]; i < cellStarts[hash + 1u]; ++i) {
+            vec4 entry = entries[i];
+            vec3 offset = position - entry.xyz;
+            float distance2 = dot(offset, offset);
+            if (floatBitsToUint(entry.w) != slot && distance2 < repulsionRadius * repulsionRadius && distance2 > 0) {
+                float distance = sqrt(distance2);
+                push += offset / distance * (1.0 - distance / repulsionRadius);
+                if (++neighbours >= maxNeighbours)
+                    return push * repulsionStrength;
+            }
+        }
+    }
+    return push * repulsionStrength;
+}
+
+float sampleTerrain(vec3 position)
+{
+    return texture(terrainDensity, position / terrainDimensions).x;
+}
+
+// Particles that would move into solid terrain stay where they were and bounce off the surface
+void collideTerrain(vec3 position, inout vec3 newPosition, inout vec3 newVelocity)
+{
+    if (any(lessThan(newPosition, vec3(0))) || any(greaterThanEqual(newPosition, terrainDimensions)) || sampleTerrain(newPosition) <= 0)
+        return;
+
+    vec3 gradient = vec3(
+        sampleTerrain(newPosition + vec3(1, 0, 0)) - sampleTerrain(newPosition - vec3(1, 0, 0)),
+        sampleTerrain(newPosition + vec3(0, 1, 0)) - sampleTerrain(newPosition - vec3(0, 1, 0)),
+        sampleTerrain(newPosition + vec3(0, 0, 1)) - sampleTerrain(newPosition - vec3(0, 0, 1)));
+    if (dot(gradient, gradient) == 0)
+        return;
+
+    // density grows into the solid, the surface normal points against the gradient
+    vec3 normal = -normalize(gradient);
+    newPosition = position;
+    float intoSurface = dot(newVelocity, normal);
+    if (intoSurface < 0)
+        newVelocity -= (1.0 + restitution) * intoSurface * normal;
+}
+
+// Trails an emitter may own, the ones after the trail its slot maps to
+#define TRAIL_PROBES 8
+
+// Appends the emitter position to its trail, an emitter without one claims the first free trail of its probe
+// window. The newest point follows the emitter until trailInterval has passed, then the next one starts.
+// Emitters whose whole window is held by others get no trail and are counted.
+void recordTrail(uint slot, vec3 position)
+{
+    uint trail = 0xFFFFFFFFu;
+    for (uint i = 0u; i < TRAIL_PROBES && trail == 0xFFFFFFFFu; i++) {
+        uint probe = (slot + i) % uint(trailCount);
+        if (trailHeaders[probe].owner == slot + 1u)
+            trail = probe;
+    }
+    if (trail == 0xFFFFFFFFu) {
+        for (uint i = 0u; i < TRAIL_PROBES; i++) {
+            uint probe = (slot + i) % uint(trailCount);
+            if (atomicCompSwap(trailHeaders[probe].owner, 0u, slot + 1u) == 0u) {
+                // claimed by this update, the trail starts at the emitter
+                trailHeaders[probe].head = 0u;
+                trailHeaders[probe].count = 1u;
+                trailHeaders[probe].timer = 0.0;
+                trailPoints[probe * uint(trailLength)] = vec4(position, 1.0);
+                return;
+            }
+        }
+        atomicAdd(traillessCount, 1u);
+        return;
+    }
+
+    // only the owner touches the rest of the header
+    uint head = trailHeaders[trail].head;
+    uint count = trailHeaders[trail].count;
+    float timer = trailHeaders[trail].timer + deltaTime;
+    if (timer >= trailInterval) {
+        timer = 0.0;
+        head = (head + 1u) % uint(trailLength);
+        count = min(count + 1u, uint(trailLength));
+        trailHeaders[trail].head = head;
+        trailHeaders[trail].count = count;
+    }
+    trailHeaders[trail].timer = timer;
+    trailPoints[trail * uint(trailLength) + head] = vec4(position, 1.0);
+}
+
+void releaseTrail(uint slot)
+{
+    for (uint i = 0u; i < TRAIL_PROBES; i++)
+        atomicCompSwap(trailHeaders[(slot + i) % uint(trailCount)].owner, slot + 1u, 0u);
+}
+
+// Frustum test of the billboard in clip space, the same as testing against the planes of cullMatrix
+// pushed out by the billboard size, followed by the projected size test
+bool isVisible(vec3 position)
+{
+    vec4 clip = cullMatrix * vec4(position, 1);
+    if (clip.w <= 0 || abs(clip.z) > clip.w)
+        return false;
+    if (abs(clip.x) > clip.w + billboardSize || abs(clip.y) > clip.w + billboardSize)
+        return false;
+    return billboardSize / clip.w * viewportHeight >= minPixelSize;
+}
+
+void addToDrawList(uint slot, vec3 position)
+{
+    if (culling && isVisible(position))
+        visibleList[atomicAdd(visibleCount, 1u)] = slot;
+}
+
+void keep(uint slot, vec3 position)
+{
+    nextAliveList[atomicAdd(nextAliveCount, 1u)] = slot;
+    addToDrawList(slot, position);
+}
+
+void kill(uint slot)
+{
+    deadList[atomicAdd(deadCount, 1)] = slot;
+}
+
+// Same rules as particleTransformGS.glsl, but the particle stays in its slot
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= aliveCount)
+        return;
+
+    uint slot = aliveList[index];
+    ParticleState particle = unpackParticle(particles[slot], unpackOrigin);
+    vec3 position = particle.position;
+    vec3 velocity = particle.velocity;
+    float oldLifeTime = particle.lifeTime;
+    float lifeTime = oldLifeTime + deltaTime;
+    float type = particle.type;
+    particle.lifeTime = lifeTime;
+    vec3 dither = randomVec3(randomKey(uint(frame), slot, 0u));
+
+    //used to spawn new emitters on runtime
+    if (type == PRIMARY_EMITTER) {
+        particle.velocity = vec3(0, 0, 0);
+        particles[slot] = packParticleDithered(particle, packOrigin, dither);
+        keep(slot, position);
+        if (spawnNewEmitter)
+            requestEmit(spawnPosition, EMITTER, 2, slot);
+    }
+    else if (type == EMITTER && lifeTime < 10.f) {
+        if (emitterDrift > 0) {
+            position += texture(turbulenceField, (position - turbulenceOffset) / turbulenceTileSize).xyz * emitterDrift * deltaTime;
+            particle.position = position;
+        }
+        if (trails)
+            recordTrail(slot, position);
+        //velocity gets used for a spawn timer for emitter particles
+        vec3 timer = velocity + vec3(deltaTime, 0, 0);
+        if (velocity.x > 0.02f) {
+            requestEmit(position, TYPE_A, 20, slot);
+            timer = vec3(0, 0, 0);
+        }
+        particle.velocity = timer;
+        particles[slot] = packParticleDithered(particle, packOrigin, dither);
+        keep(slot, position);
+    }
+    else if (type == TYPE_A && oldLifeTime < 1.0f) {
+        vec3 newPosition = position + velocity * deltaTime;
+        //gravity
+        vec3 newVelocity = velocity + vec3(0, 10, 0) * deltaTime;
+        if (turbulence)
+            newVelocity += texture(turbulenceField, (newPosition - turbulenceOffset) / turbulenceTileSize).xyz * turbulenceStrength * deltaTime;
+        if (interaction) {
+            newVelocity += repulsion(position, slot) * deltaTime;
+            if (terrainCollision)
+                collideTerrain(position, newPosition, newVelocity);
+        }
+        particle.position = newPosition;
+        particle.velocity = newVelocity;
+        particles[slot] = packParticleDithered(particle, packOrigin, dither);
+        keep(slot, newPosition);
+    }
+    else {
+        if (trails && type == EMITTER)
+            releaseTrail(slot);
+        kill(slot);
+    }
+}
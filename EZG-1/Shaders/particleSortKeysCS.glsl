@@ -0,0 +1,55 @@
+#version 430 core
+layout(local_size_x = 256) in;
+
+#include "particlePacking.glsl"
+
+layout(std430, binding = 0) readonly buffer ParticleBuffer { uvec4 particles[]; };
+// alive or visible list, whichever is drawn
+layout(std430, binding = 2) readonly buffer DrawList { uint drawList[]; };
+layout(std430, binding = 6) readonly buffer IndirectArgs
+{
+    uint simulateGroups[3];
+    uint emitGroups[3];
+    uint drawCount;
+    uint drawInstanceCount;
+    uint drawFirst;
+    uint drawBaseInstance;
+    uint quadVertexCount;
+    uint quadInstanceCount;
+    uint quadFirst;
+    uint quadBaseInstance;
+};
+layout(std430, binding = 7) writeonly buffer SortKeys { uint sortKeys[]; };
+layout(std430, binding = 8) writeonly buffer SortIndices { uint sortIndices[]; };
+
+uniform mat4 modelView;
+uniform int capacity;
+// origin the particle positions are packed relative to
+uniform vec3 origin;
+
+// Same mapping as SortableKey in RadixSort.h
+uint sortableKey(float value)
+{
+    uint bits = floatBitsToUint(value);
+    return bits ^ ((bits >> 31) != 0u ? 0xFFFFFFFFu : 0x80000000u);
+}
+
+// Writes a back to front key for every drawn particle, the unused rest of the buffer sorts behind them
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= uint(capacity))
+        return;
+
+    if (index < drawCount) {
+        uint slot = drawList[index];
+        float depth = -(modelView * vec4(unpackPosition(particles[slot], origin), 1.0)).z;
+        // inverted so the farthest particle comes first
+        sortKeys[index] = ~sortableKey(depth);
+        sortIndices[index] = slot;
+    }
+    else {
+        sortKeys[index] = 0xFFFFFFFFu;
+        sortIndices[index] = 0u;
+    }
+}
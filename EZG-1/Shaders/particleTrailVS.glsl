@@ -0,0 +1,61 @@
+#version 430 core
+
+// Same layout as TrailHeader in ParticleTrails.cpp
+struct TrailHeader
+{
+    uint owner;
+    uint head;
+    uint count;
+    float timer;
+};
+
+layout(std430, binding = 16) readonly buffer TrailHeaders { TrailHeader trailHeaders[]; };
+layout(std430, binding = 17) readonly buffer TrailPoints { vec4 trailPoints[]; };
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+uniform int trailLength;
+uniform float trailWidth;
+
+// same block as the particleRenderGS.glsl output, so the ribbons share particleRenderPS.glsl
+out GS_Out{
+    vec4 fColor;
+    vec2 texCoord;
+    float viewDepth;
+} vs_out;
+
+// View space position of the i-th point of the trail, 0 is the oldest
+vec3 trailPoint(uint trail, TrailHeader header, int i)
+{
+    uint point = uint(clamp(i, 0, int(header.count) - 1));
+    uint index = (header.head + uint(trailLength) - (header.count - 1u) + point) % uint(trailLength);
+    return (view * model * vec4(trailPoints[trail * uint(trailLength) + index].xyz, 1.0)).xyz;
+}
+
+// One instance per trail, two vertices per point on either side of the trail, facing the camera
+void main() {
+    uint trail = uint(gl_InstanceID);
+    TrailHeader header = trailHeaders[trail];
+    if (header.owner == 0u || header.count < 2u) {
+        // outside the clip volume, the whole strip gets clipped
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        return;
+    }
+
+    // points past the written ones collapse onto the newest, their triangles have no area
+    int i = gl_VertexID >> 1;
+    float side = (gl_VertexID & 1) == 0 ? -1.0 : 1.0;
+    vec3 position = trailPoint(trail, header, i);
+    vec3 tangent = trailPoint(trail, header, i + 1) - trailPoint(trail, header, i - 1);
+    // across the trail and the line of sight
+    vec3 across = cross(tangent, position);
+    across = dot(across, across) > 1e-12 ? normalize(across) : vec3(1.0, 0.0, 0.0);
+
+    // thin and transparent at the oldest point, full at the emitter
+    float age = float(min(i, int(header.count) - 1) + 1) / float(header.count);
+    vs_out.fColor = vec4(1.0, 0.6, 0.25, age);
+    vs_out.texCoord = vec2(side * 0.5 + 0.5, 0.5);
+    vs_out.viewDepth = -position.z;
+    gl_Position = projection * vec4(position + across * side * trailWidth * age, 1.0);
+}
@@ -2,6 +2,8 @@
 layout(points) in;
 layout(points, max_vertices = 30) out;
 
+#include "particleRandom.glsl"
+
 in VS_OUT{
     vec3 position;
     vec3 velocity;
@@ -16,8 +18,8 @@ out float outLifeTime;
 out float outType;
 
 uniform float deltaTime;
-uniform float programTime;
-uniform sampler1D randomTexture;
+// updates since the last reset, keys the spawn velocities together with the emitter index
+uniform int frame;
 uniform bool spawnNewEmitter;
 uniform vec3 spawnPosition;
 
@@ -26,18 +28,13 @@ uniform vec3 spawnPosition;
 #define TYPE_A 2.0f                                                    
 #define TYPE_B 3.0f         
 
-vec3 randomVec(float pos) {
-    //vec3 rnd = texture(randomTexture, pos).xyz; //[0...1]
-    return vec3(1, 1, 1);
-}
-
 void spawnParticle(vec3 position, int amount)
 {
     outPosition = position.xyz;
     outLifeTime = 0;
     outType = TYPE_A;
     for (int i = 0; i < amount; ++i) {
-        outVelocity = randomVec(((programTime + i) * gs_in[0].lifeTime / 13.f) / 1000.f) * 10;
+        outVelocity = spawnVelocity(uint(frame), uint(gl_PrimitiveIDIn), uint(i));
         EmitVertex();
         EndPrimitive();
     }
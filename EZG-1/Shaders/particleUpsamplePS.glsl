@@ -0,0 +1,50 @@
+#version 430 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// premultiplied particles and their linear depth at the low resolution
+layout(binding = 0) uniform sampler2D particles;
+layout(binding = 1) uniform sampler2D lowLinearDepth;
+// full resolution scene depth
+layout(binding = 2) uniform sampler2D sceneDepth;
+uniform int divisor;
+uniform float nearPlane;
+uniform float farPlane;
+
+// relative depth difference from which a low resolution texel counts as across an edge
+#define DEPTH_TOLERANCE 0.1
+
+float linearDepth(float depth)
+{
+    float ndc = depth * 2.0 - 1.0;
+    return 2.0 * nearPlane * farPlane / (farPlane + nearPlane - ndc * (farPlane - nearPlane));
+}
+
+// Depth aware upsample of the soft particles, see ParticleTransparency.h
+void main()
+{
+    ivec2 lowSize = textureSize(particles, 0);
+    float depth = linearDepth(texelFetch(sceneDepth, ivec2(gl_FragCoord.xy), 0).r);
+
+    // the four low resolution texels the bilinear filter would blend
+    vec2 p = gl_FragCoord.xy / float(divisor) - 0.5;
+    ivec2 base = ivec2(floor(p));
+    ivec2 nearest = clamp(base, ivec2(0), lowSize - 1);
+    float nearestDifference = 1e30;
+    bool edge = false;
+    for (int i = 0; i < 4; ++i) {
+        ivec2 texel = clamp(base + ivec2(i & 1, i >> 1), ivec2(0), lowSize - 1);
+        float difference = abs(texelFetch(lowLinearDepth, texel, 0).r - depth);
+        edge = edge || difference > DEPTH_TOLERANCE * depth;
+        if (difference < nearestDifference) {
+            nearestDifference = difference;
+            nearest = texel;
+        }
+    }
+
+    vec4 color = edge ? texelFetch(particles, nearest, 0) : texture(particles, (p + 0.5) / vec2(lowSize));
+    if (color.a <= 0.0)
+        discard;
+    FragColor = color;
+}
@@ -0,0 +1,31 @@
+#version 430 core
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 0) readonly buffer KeysIn { uint keysIn[]; };
+layout(std430, binding = 4) writeonly buffer Histograms { uint histograms[]; };
+
+uniform int count;
+uniform int shift;
+
+// keys per work group, 4 per invocation
+#define BLOCK_SIZE 1024u
+
+shared uint bins[256];
+
+void main()
+{
+    uint local = gl_LocalInvocationID.x;
+    uint group = gl_WorkGroupID.x;
+    bins[local] = 0u;
+    barrier();
+
+    for (uint k = 0u; k < 4u; ++k) {
+        uint i = group * BLOCK_SIZE + k * 256u + local;
+        if (i < uint(count))
+            atomicAdd(bins[(keysIn[i] >> uint(shift)) & 0xFFu], 1u);
+    }
+    barrier();
+
+    // digit major, so scanning the whole buffer gives every group its output offset per digit
+    histograms[local * gl_NumWorkGroups.x + group] = bins[local];
+}
@@ -0,0 +1,39 @@
+#version 430 core
+layout(local_size_x = 1024) in;
+
+layout(std430, binding = 4) buffer Histograms { uint histograms[]; };
+
+// number of histogram entries, 256 per sort work group
+uniform int size;
+
+shared uint sums[1024];
+
+// Exclusive prefix sum of the histograms in place, run as a single work group.
+// Every invocation scans a contiguous segment, the segment totals are scanned in shared memory.
+void main()
+{
+    uint local = gl_LocalInvocationID.x;
+    uint segment = (uint(size) + 1023u) / 1024u;
+    uint begin = min(local * segment, uint(size));
+    uint end = min(begin + segment, uint(size));
+
+    uint total = 0u;
+    for (uint i = begin; i < end; ++i)
+        total += histograms[i];
+
+    sums[local] = total;
+    barrier();
+    for (uint offset = 1u; offset < 1024u; offset <<= 1) {
+        uint value = local >= offset ? sums[local - offset] : 0u;
+        barrier();
+        sums[local] += value;
+        barrier();
+    }
+
+    uint running = sums[local] - total;
+    for (uint i = begin; i < end; ++i) {
+        uint value = histograms[i];
+        histograms[i] = running;
+        running += value;
+    }
+}
@@ -0,0 +1,93 @@
+#version 430 core
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 0) readonly buffer KeysIn { uint keysIn[]; };
+layout(std430, binding = 1) readonly buffer ValuesIn { uint valuesIn[]; };
+layout(std430, binding = 2) writeonly buffer KeysOut { uint keysOut[]; };
+layout(std430, binding = 3) writeonly buffer ValuesOut { uint valuesOut[]; };
+layout(std430, binding = 4) readonly buffer Histograms { uint histograms[]; };
+
+uniform int count;
+uniform int shift;
+
+#define BLOCK_SIZE 1024u
+
+// the block is sorted by digit in shared memory first, that keeps equal digits in input order
+shared uint blockKeys[2][BLOCK_SIZE];
+shared uint blockIndices[2][BLOCK_SIZE];
+shared uint sums[256];
+shared uint digitStart[256];
+
+uint digitOf(uint key)
+{
+    return (key >> uint(shift)) & 0xFFu;
+}
+
+void main()
+{
+    uint local = gl_LocalInvocationID.x;
+    uint group = gl_WorkGroupID.x;
+
+    // keys past the end sort behind every valid key of the block and are never written
+    for (uint k = 0u; k < 4u; ++k) {
+        uint i = group * BLOCK_SIZE + local * 4u + k;
+        blockKeys[0][local * 4u + k] = i < uint(count) ? keysIn[i] : 0xFFFFFFFFu;
+        blockIndices[0][local * 4u + k] = i;
+    }
+    barrier();
+
+    // one stable split per digit bit, zeros to the front
+    uint src = 0u;
+    for (uint bit = 0u; bit < 8u; ++bit) {
+        uint zeros[4];
+        uint localZeros = 0u;
+        for (uint k = 0u; k < 4u; ++k) {
+            zeros[k] = localZeros;
+            localZeros += 1u - ((digitOf(blockKeys[src][local * 4u + k]) >> bit) & 1u);
+        }
+
+        sums[local] = localZeros;
+        barrier();
+        for (uint offset = 1u; offset < 256u; offset <<= 1) {
+            uint value = local >= offset ? sums[local - offset] : 0u;
+            barrier();
+            sums[local] += value;
+            barrier();
+        }
+        uint zerosBefore = sums[local] - localZeros;
+        uint totalZeros = sums[255];
+
+        for (uint k = 0u; k < 4u; ++k) {
+            uint index = local * 4u + k;
+            uint key = blockKeys[src][index];
+            uint zeroRank = zerosBefore + zeros[k];
+            uint dst = ((digitOf(key) >> bit) & 1u) == 0u ? zeroRank : totalZeros + index - zeroRank;
+            blockKeys[1u - src][dst] = key;
+            blockIndices[1u - src][dst] = blockIndices[src][index];
+        }
+        src = 1u - src;
+        barrier();
+    }
+
+    // first position of every digit in the sorted block
+    for (uint k = 0u; k < 4u; ++k) {
+        uint index = local * 4u + k;
+        uint digit = digitOf(blockKeys[src][index]);
+        if (index == 0u || digitOf(blockKeys[src][index - 1u]) != digit)
+            digitStart[digit] = index;
+    }
+    barrier();
+
+    for (uint k = 0u; k < 4u; ++k) {
+        uint index = local * 4u + k;
+        uint source = blockIndices[src][index];
+        if (source >= uint(count))
+            continue;
+
+        uint key = blockKeys[src][index];
+        uint digit = digitOf(key);
+        uint dst = histograms[digit * gl_NumWorkGroups.x + group] + index - digitStart[digit];
+        keysOut[dst] = key;
+        valuesOut[dst] = valuesIn[source];
+    }
+}
@@ -1,14 +1,35 @@
-#version 330 core
-layout (location = 0) out vec3 color;
+#version 430 core
+// nothing here discards or writes the depth, hidden casters are rejected before the shader runs
+layout(early_fragment_tests) in;
+layout (location = 0) out vec4 color;
 
 in VS_OUT
 {
     vec4 FragPos;
 } fs_in;
 
+// ShadowMode in VarianceShadowMap.h
+#define SHADOW_VSM 0
+#define SHADOW_EVSM2 1
+#define SHADOW_EVSM4 2
+uniform int shadowMode;
+uniform float positiveExponent;
+uniform float negativeExponent;
+
 void main()
 {
     float depth = fs_in.FragPos.z / fs_in.FragPos.w;
+
+    if (shadowMode != SHADOW_VSM)
+    {
+        // exponential warps of the depth in [-1, 1], the positive one for the shadow, the negative one
+        // for the receivers in front of an occluder
+        float positive = exp(positiveExponent * depth);
+        float negative = -exp(-negativeExponent * depth);
+        color = vec4(positive, positive * positive, negative, negative * negative);
+        return;
+    }
+
     depth = depth * 0.5 + 0.5;
 
     float moment1 = depth;
@@ -20,6 +41,6 @@ void main()
     moment2 += 0.25 * (dx * dx + dy * dy);
 
     // Debug shit
-    color = vec3(moment1, moment2, 0.0);
+    color = vec4(moment1, moment2, 0.0, 0.0);
     //FragColor = vec4(moment1, moment2, 0.0, 0.0);
 }
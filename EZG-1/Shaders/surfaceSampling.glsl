@@ -0,0 +1,41 @@
+// Uniform points on the emission surface, the same sampling as EmissionSurface::Sample.
+// Include after particleRandom.glsl.
+
+struct SurfaceTriangle
+{
+    vec4 a;
+    vec4 b;
+    vec4 c;
+};
+
+// Column of the alias table, the column's triangle is picked with the given probability, its alias otherwise
+struct AliasEntry
+{
+    float probability;
+    uint alias;
+};
+
+layout(std430, binding = 14) readonly buffer SurfaceTriangles { SurfaceTriangle surfaceTriangles[]; };
+layout(std430, binding = 15) readonly buffer AliasTable { AliasEntry aliasTable[]; };
+
+uniform int surfaceTriangleCount;
+
+vec3 sampleSurface(uint key)
+{
+    // salted so the position is not correlated with the spawn velocity drawn from the same key
+    uint x = pcgHash(key ^ 0xA511E9B3u);
+    uint y = pcgHash(x);
+    uint z = pcgHash(y);
+    uint w = pcgHash(z);
+
+    // column from the full 32 bits, the high word of x * count
+    uint column, low;
+    umulExtended(x, uint(surfaceTriangleCount), column, low);
+    AliasEntry entry = aliasTable[column];
+    SurfaceTriangle triangle = surfaceTriangles[randomFloat(y) < entry.probability ? column : entry.alias];
+
+    // uniform barycentric coordinates, the square root keeps the density constant towards the corner a
+    float s = sqrt(randomFloat(z));
+    float t = randomFloat(w);
+    return triangle.a.xyz * (1.0 - s) + triangle.b.xyz * (s * (1.0 - t)) + triangle.c.xyz * (s * t);
+}
@@ -6,21 +6,42 @@ in VS_OUT
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
-    vec4 FragPosLightSpace;
+    float ViewDepth;
 } fs_in;
 
 uniform vec3 lightPos;
 uniform vec3 viewPos;
 
 uniform sampler2D diffuseTexture;
-uniform sampler2D shadowMap;
+// one layer of moments per cascade, see ShadowCascades.h
+uniform sampler2DArray shadowMap;
+
+// MAX_CASCADES in ShadowCascades.h
+#define MAX_CASCADES 4
+uniform int cascadeCount;
+uniform mat4 lightSpaceMatrices[MAX_CASCADES];
+// view depth every cascade ends at
+uniform float cascadeSplits[MAX_CASCADES];
+
+// ShadowMode in VarianceShadowMap.h
+#define SHADOW_VSM 0
+#define SHADOW_EVSM2 1
+#define SHADOW_EVSM4 2
+uniform int shadowMode;
+uniform float positiveExponent;
+uniform float negativeExponent;
+// upper bounds below it count as shadowed, see VarianceShadowMap::LightBleedingReduction
+uniform float lightBleedingReduction;
+
+// the shadow factor alone, and an unfiltered depth compare of the VSM moments as its reference
+uniform bool visibilityOnly = false;
+uniform bool hardShadows = false;
 
 vec3 projCoords;
+int cascade;
 
-float chebyshevUpperBound(float distance)
+float chebyshevUpperBound(vec2 moments, float distance, float minVariance)
 {
-	vec2 moments = texture2D(shadowMap, projCoords.xy).rg;
-	
 	// Surface is fully lit. as the current fragment is before the light occluder
 	if (distance <= moments.x)
 		return 1.0 ;
@@ -28,22 +49,70 @@ float chebyshevUpperBound(float distance)
 	// The fragment is either in shadow or penumbra. We now use chebyshev's upperBound to check
 	// How likely this pixel is to be lit (p_max)
 	float variance = moments.y - (moments.x*moments.x);
-	variance = max(variance,0.00002);
+	variance = max(variance,minVariance);
 
 	float d = distance - moments.x;
 	float p_max = variance / (variance + d*d);
 
-	return p_max;
+	// the tail of the bound is where the light bleeds through, cut it off and stretch the rest to [0, 1]
+	return clamp((p_max - lightBleedingReduction) / (1.0 - lightBleedingReduction), 0.0, 1.0);
+}
+
+float shadowFactor(float distance)
+{
+	// pre-filtered, mipmapped moments, sampled trilinear and anisotropic
+	vec4 moments = texture(shadowMap, vec3(projCoords.xy, cascade));
+
+	if (shadowMode == SHADOW_VSM)
+		return chebyshevUpperBound(moments.xy, distance, 0.00002);
+
+	// the same warps as storeDepthPS.glsl. A variance scales with the square of the warp's slope, the
+	// minimum variance of VSM times the squared slope is the same minimum in depth units
+	float depth = distance * 2.0 - 1.0;
+	float positive = exp(positiveExponent * depth);
+	float positiveSlope = 2.0 * positiveExponent * positive;
+	float shadow = chebyshevUpperBound(moments.xy, positive, 0.00002 * positiveSlope * positiveSlope);
+	if (shadowMode == SHADOW_EVSM4)
+	{
+		float negative = -exp(-negativeExponent * depth);
+		float negativeSlope = 2.0 * negativeExponent * negative;
+		shadow = min(shadow, chebyshevUpperBound(moments.zw, negative, 0.00002 * negativeSlope * negativeSlope));
+	}
+	return shadow;
+}
+
+float hardShadow(float distance)
+{
+	// the nearest texel of the raw depth, biased against acne
+	vec3 size = vec3(textureSize(shadowMap, 0));
+	ivec2 texel = clamp(ivec2(projCoords.xy * size.xy), ivec2(0), ivec2(size.xy) - 1);
+	float depth = texelFetch(shadowMap, ivec3(texel, cascade), 0).r;
+	return distance > depth + 0.002 ? 0.0 : 1.0;
 }
 
 
 void main()
 {	
-    vec4 fragPosLightSpace = fs_in.FragPosLightSpace;
+    // the first cascade that reaches the fragment, none past the last one
+    int reached = 0;
+    while (reached < cascadeCount && fs_in.ViewDepth > cascadeSplits[reached])
+        reached++;
+
+    // sampled outside of any branch, the mip selection needs the derivatives of the neighbouring pixels
+    cascade = min(reached, cascadeCount - 1);
+    vec4 fragPosLightSpace = lightSpaceMatrices[cascade] * vec4(fs_in.FragPos, 1.0);
     projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     projCoords = projCoords * 0.5 + 0.5;
-
-	float shadow = chebyshevUpperBound(projCoords.z);
+    float shadow = shadowFactor(projCoords.z);
+    if (hardShadows)
+        shadow = hardShadow(projCoords.z);
+    if (reached == cascadeCount)
+        shadow = 1.0;
+    if (visibilityOnly)
+    {
+        FragColor = vec4(shadow);
+        return;
+    }
 
     // LEARN OPENGL
     vec3 color = texture(diffuseTexture, fs_in.TexCoords).rgb;
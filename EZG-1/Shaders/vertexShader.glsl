@@ -21,12 +21,12 @@ out VS_OUT {
 } vs_out;
 
 uniform sampler3D densityTexture;
-uniform int cameraSector;
 
 
 void main()
 {
-    vs_out.wsCoord = vec3(aPos.x, aPos.y, cameraSector * (densityTextureDimensions.z - 1) + gl_InstanceID);
+    // cells are placed in the local space of their sector, the model matrix moves the sector relative to the floating origin
+    vs_out.wsCoord = vec3(aPos.x, aPos.y, gl_InstanceID);
     vs_out.uvw = vec3(aPos.x / densityTextureDimensions.x, aPos.y / densityTextureDimensions.y,  gl_InstanceID / densityTextureDimensions.z - 1);
 
     vec3 step = vec3(1.0 / densityTextureDimensions.x, 0, 1.0 / densityTextureDimensions.z);
@@ -0,0 +1,55 @@
+#version 430 core
+// BLUR_TILE_SIZE in VarianceShadowMap.cpp
+layout(local_size_x = 128) in;
+
+// MAX_BLUR_RADIUS in VarianceShadowMap.h
+#define MAX_RADIUS 32
+#define TILE_SIZE 128
+// the format of the moments, set by VarianceShadowMap::LoadShaders
+#ifndef MOMENT_FORMAT
+#define MOMENT_FORMAT rg16f
+#endif
+
+// one layer per shadow cascade
+layout(binding = 0) uniform sampler2DArray source;
+layout(MOMENT_FORMAT, binding = 0) writeonly uniform image2DArray destination;
+
+// rows of the map for the horizontal pass, columns for the vertical one
+uniform bool horizontal;
+uniform int radius;
+// normalized Gaussian weights from the center out
+uniform float weights[MAX_RADIUS + 1];
+
+// the tile and the radius of texels on either side of it
+// all four channels, the exponential shadow modes store two pairs of moments
+shared vec4 tile[TILE_SIZE + 2 * MAX_RADIUS];
+
+ivec3 texel(int along, int across)
+{
+    return ivec3(horizontal ? ivec2(along, across) : ivec2(across, along), int(gl_WorkGroupID.z));
+}
+
+// One pass of the separable blur of the shadow map moments. A work group loads its part of a row or
+// column into shared memory once, so every texel is fetched about once instead of 2 * radius + 1 times.
+void main()
+{
+    ivec2 size = textureSize(source, 0).xy;
+    int length = horizontal ? size.x : size.y;
+    int across = int(gl_WorkGroupID.y);
+    int start = int(gl_WorkGroupID.x) * TILE_SIZE - radius;
+
+    // clamped to the edge, the moments outside the map repeat the border
+    for (int i = int(gl_LocalInvocationID.x); i < TILE_SIZE + 2 * radius; i += TILE_SIZE)
+        tile[i] = texelFetch(source, texel(clamp(start + i, 0, length - 1), across), 0);
+    barrier();
+
+    int along = int(gl_GlobalInvocationID.x);
+    if (along >= length)
+        return;
+
+    int center = int(gl_LocalInvocationID.x) + radius;
+    vec4 moments = tile[center] * weights[0];
+    for (int i = 1; i <= radius; ++i)
+        moments += (tile[center - i] + tile[center + i]) * weights[i];
+    imageStore(destination, texel(along, across), moments);
+}
@@ -0,0 +1,66 @@
+#include "ShadowCascades.h"
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+ShadowCascades::ShadowCascades(int cascadeCount) : mCascadeCount(std::min(std::max(cascadeCount, 1), MAX_CASCADES))
+{
+	for (int i = 0; i < MAX_CASCADES; i++)
+	{
+		mMatrices[i] = glm::mat4(1.0f);
+		mSplits[i] = 0.0f;
+	}
+}
+
+void ShadowCascades::Fit(const glm::mat4& view, float fovY, float aspect, float nearPlane, glm::vec3 lightDirection, int width, int height)
+{
+	glm::mat4 cameraToWorld = glm::inverse(view);
+	float tanY = std::tan(fovY * 0.5f);
+	float tanX = tanY * aspect;
+
+	glm::vec3 direction = glm::normalize(lightDirection);
+	// any up vector that is not parallel to the light
+	glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), direction, up);
+
+	float start = nearPlane;
+	for (int i = 0; i < mCascadeCount; i++)
+	{
+		float fraction = float(i + 1) / mCascadeCount;
+		float logarithmic = nearPlane * std::pow(ShadowDistance / nearPlane, fraction);
+		float uniform = nearPlane + (ShadowDistance - nearPlane) * fraction;
+		float end = SplitLambda * logarithmic + (1.0f - SplitLambda) * uniform;
+		mSplits[i] = end;
+
+		// bounding sphere of the slice, its center on the view axis where it is closest to all eight corners
+		float tan2 = tanX * tanX + tanY * tanY;
+		float centerDepth = std::min(end, (start + end) * 0.5f * (1.0f + tan2));
+		float radius = std::max(
+			std::sqrt(tan2 * start * start + (centerDepth - start) * (centerDepth - start)),
+			std::sqrt(tan2 * end * end + (end - centerDepth) * (end - centerDepth)));
+		// a little larger so the blur kernel finds texels around the edge of the slice
+		radius *= 1.05f;
+		glm::vec3 center = glm::vec3(cameraToWorld * glm::vec4(0.0f, 0.0f, -centerDepth, 1.0f));
+
+		// snap the center to whole texels of the light's view, the projection only ever moves by texels. The depth
+		// along the light is snapped as well, so the matrix stays bit identical until the camera moved a texel
+		glm::vec2 texelSize = glm::vec2(2.0f * radius / width, 2.0f * radius / height);
+		float depthStep = std::max(texelSize.x, texelSize.y);
+		glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(center, 1.0f));
+		lightCenter.x = std::floor(lightCenter.x / texelSize.x) * texelSize.x;
+		lightCenter.y = std::floor(lightCenter.y / texelSize.y) * texelSize.y;
+		lightCenter.z = std::floor(lightCenter.z / depthStep) * depthStep;
+		glm::vec3 snappedCenter = glm::vec3(glm::inverse(lightRotation) * glm::vec4(lightCenter, 1.0f));
+
+		// the eye sits behind the sphere, far enough for the casters between it and the slice. The snapped
+		// center is up to one step off the real one, the far plane leaves room for that
+		glm::vec3 eye = snappedCenter - direction * (radius + CasterDistance);
+		glm::mat4 lightView = glm::lookAt(eye, snappedCenter, up);
+		glm::mat4 lightProjection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius + CasterDistance + depthStep);
+		mMatrices[i] = lightProjection * lightView;
+
+		start = end;
+	}
+}
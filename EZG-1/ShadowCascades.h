@@ -0,0 +1,40 @@
+#pragma once
+#include "glm/glm.hpp"
+
+// Splits the camera frustum into cascades for a directional light and fits a light projection to each.
+// The split distances blend logarithmic and uniform splits (the practical split scheme of Zhang et al.),
+// so the near cascades get most of the resolution. Every cascade is fitted to the bounding sphere of its
+// frustum slice, which keeps its size the same while the camera turns, and its origin is snapped to whole
+// shadow map texels, so the shadow edges do not shimmer while the camera moves. The depth along the light is
+// snapped by a texel too, so a cascade's matrix only changes once the camera moved a texel.
+class ShadowCascades
+{
+public:
+	static const int MAX_CASCADES = 4;
+
+	ShadowCascades(int cascadeCount = 4);
+
+	int CascadeCount() const { return mCascadeCount; }
+	// Distance the cascades cover, shadows end there even if the camera sees further
+	float ShadowDistance = 60.0f;
+	// 0 gives uniform, 1 logarithmic splits
+	float SplitLambda = 0.75f;
+	// Distance behind a cascade's sphere the light projection still includes, for casters outside the view
+	float CasterDistance = 20.0f;
+
+	// Fits the cascades to the frustum of a perspective camera with view matrix view, for a light
+	// shining along lightDirection onto shadow maps of width x height texels
+	void Fit(const glm::mat4& view, float fovY, float aspect, float nearPlane, glm::vec3 lightDirection, int width, int height);
+
+	// World to light clip space of a cascade
+	const glm::mat4& LightSpaceMatrix(int cascade) const { return mMatrices[cascade]; }
+	const glm::mat4* LightSpaceMatrices() const { return mMatrices; }
+	// View depth the cascade ends at, the first one starts at the near plane
+	float SplitDistance(int cascade) const { return mSplits[cascade]; }
+	const float* SplitDistances() const { return mSplits; }
+
+private:
+	int mCascadeCount;
+	glm::mat4 mMatrices[MAX_CASCADES];
+	float mSplits[MAX_CASCADES];
+};
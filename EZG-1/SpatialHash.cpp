@@ -0,0 +1,212 @@
+#include "SpatialHash.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Particles per task
+static const unsigned int CHUNK_SIZE = 16384;
+
+SpatialHash::SpatialHash(WorkerPool& workers, unsigned int tableSize) : mWorkers(workers)
+{
+	unsigned int size = 1;
+	while (size < tableSize)
+		size <<= 1;
+	mTableMask = size - 1;
+	mCellStarts.reset(new std::atomic<unsigned int>[size + 1]);
+	for (unsigned int i = 0; i <= size; i++)
+		mCellStarts[i].store(0, std::memory_order_relaxed);
+}
+
+void SpatialHash::Build(const ParticleArrays& particles, const unsigned char* alive, unsigned int count, float cellSize)
+{
+	mCellSize = cellSize;
+	if (mParticleCells.size() < count)
+	{
+		mParticleCells.resize(count);
+		mLocalOffsets.resize(count);
+		mSortedIndices.resize(count);
+		mSortedPositions.resize(count);
+	}
+
+	unsigned int tableSize = mTableMask + 1;
+	for (unsigned int i = 0; i <= tableSize; i++)
+		mCellStarts[i].store(0, std::memory_order_relaxed);
+
+	unsigned int chunks = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+	// 1. count the particles per cell, the returned count is the particle's offset inside its cell
+	mWorkers.Run(chunks, [&](unsigned int chunk) {
+		unsigned int end = std::min(count, (chunk + 1) * CHUNK_SIZE);
+		for (unsigned int i = chunk * CHUNK_SIZE; i < end; i++)
+		{
+			if (alive != nullptr && !alive[i])
+			{
+				mParticleCells[i] = INVALID_CELL;
+				continue;
+			}
+			unsigned int hash = Hash(Cell(glm::vec3(particles.positionX[i], particles.positionY[i], particles.positionZ[i])));
+			mParticleCells[i] = hash;
+			mLocalOffsets[i] = mCellStarts[hash].fetch_add(1, std::memory_order_relaxed);
+		}
+	});
+
+	// 2. exclusive prefix sum turns the counts into cell starts, the extra last entry ends the last cell
+	unsigned int total = 0;
+	for (unsigned int i = 0; i <= tableSize; i++)
+	{
+		unsigned int n = mCellStarts[i].load(std::memory_order_relaxed);
+		mCellStarts[i].store(total, std::memory_order_relaxed);
+		total += n;
+	}
+	mSortedCount = total;
+
+	// 3. scatter the indices into cell order
+	mWorkers.Run(chunks, [&](unsigned int chunk) {
+		unsigned int end = std::min(count, (chunk + 1) * CHUNK_SIZE);
+		for (unsigned int i = chunk * CHUNK_SIZE; i < end; i++)
+		{
+			unsigned int hash = mParticleCells[i];
+			if (hash == INVALID_CELL)
+				continue;
+			mSortedIndices[mCellStarts[hash].load(std::memory_order_relaxed) + mLocalOffsets[i]] = i;
+		}
+	});
+
+	// 4. the offsets inside a slot come in atomic order, sorting every slot by index makes the neighbour
+	// order and with it which neighbours a capped query sees the same in every run
+	unsigned int slotChunks = (tableSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	mWorkers.Run(slotChunks, [&](unsigned int chunk) {
+		unsigned int slotEnd = std::min(tableSize, (chunk + 1) * CHUNK_SIZE);
+		for (unsigned int hash = chunk * CHUNK_SIZE; hash < slotEnd; hash++)
+		{
+			unsigned int start = mCellStarts[hash].load(std::memory_order_relaxed);
+			unsigned int end = mCellStarts[hash + 1].load(std::memory_order_relaxed);
+			if (end - start > 1)
+				std::sort(mSortedIndices.begin() + start, mSortedIndices.begin() + end);
+			for (unsigned int out = start; out < end; out++)
+			{
+				unsigned int i = mSortedIndices[out];
+				mSortedPositions[out] = glm::vec3(particles.positionX[i], particles.positionY[i], particles.positionZ[i]);
+			}
+		}
+	});
+}
+
+// Trilinear density sample in voxel coordinates, clamped to the volume
+static float sampleDensity(const float* density, glm::ivec3 dimensions, glm::vec3 position)
+{
+	glm::vec3 p = glm::clamp(position, glm::vec3(0.0f), glm::vec3(dimensions - 1));
+	glm::ivec3 p0 = glm::min(glm::ivec3(p), dimensions - 2);
+	glm::vec3 t = p - glm::vec3(p0);
+
+	auto at = [&](int x, int y, int z) {
+		return density[((size_t)z * dimensions.y + y) * dimensions.x + x];
+	};
+	float c00 = glm::mix(at(p0.x, p0.y, p0.z), at(p0.x + 1, p0.y, p0.z), t.x);
+	float c10 = glm::mix(at(p0.x, p0.y + 1, p0.z), at(p0.x + 1, p0.y + 1, p0.z), t.x);
+	float c01 = glm::mix(at(p0.x, p0.y, p0.z + 1), at(p0.x + 1, p0.y, p0.z + 1), t.x);
+	float c11 = glm::mix(at(p0.x, p0.y + 1, p0.z + 1), at(p0.x + 1, p0.y + 1, p0.z + 1), t.x);
+	return glm::mix(glm::mix(c00, c10, t.y), glm::mix(c01, c11, t.y), t.z);
+}
+
+void SpatialHash::SetTerrain(const float* density, glm::ivec3 dimensions, float cellSize)
+{
+	mTerrainCellSize = cellSize;
+	mTerrainDimensions = glm::ivec3(glm::ceil(glm::vec3(dimensions) / cellSize));
+	mTerrainCells.resize((size_t)mTerrainDimensions.x * mTerrainDimensions.y * mTerrainDimensions.z);
+
+	mWorkers.Run(mTerrainDimensions.z, [&](unsigned int z) {
+		for (int y = 0; y < mTerrainDimensions.y; y++)
+		{
+			for (int x = 0; x < mTerrainDimensions.x; x++)
+			{
+				glm::vec3 center = (glm::vec3(x, y, z) + 0.5f) * cellSize;
+				glm::vec3 gradient(
+					sampleDensity(density, dimensions, center + glm::vec3(1, 0, 0)) - sampleDensity(density, dimensions, center - glm::vec3(1, 0, 0)),
+					sampleDensity(density, dimensions, center + glm::vec3(0, 1, 0)) - sampleDensity(density, dimensions, center - glm::vec3(0, 1, 0)),
+					sampleDensity(density, dimensions, center + glm::vec3(0, 0, 1)) - sampleDensity(density, dimensions, center - glm::vec3(0, 0, 1)));
+				mTerrainCells[((size_t)z * mTerrainDimensions.y + y) * mTerrainDimensions.x + x] = glm::vec4(gradient * 0.5f, sampleDensity(density, dimensions, center));
+			}
+		}
+	});
+}
+
+glm::vec4 SpatialHash::TerrainDensity(glm::vec3 position) const
+{
+	glm::ivec3 cell = glm::ivec3(glm::floor(position / mTerrainCellSize));
+	if (mTerrainCells.empty() || glm::any(glm::lessThan(cell, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(cell, mTerrainDimensions)))
+		return glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+	return mTerrainCells[((size_t)cell.z * mTerrainDimensions.y + cell.y) * mTerrainDimensions.x + cell.x];
+}
+
+void SpatialHash::Interact(ParticleArrays& particles, const unsigned char* alive, unsigned int count, const ParticleInteraction& settings, float deltaTime)
+{
+	unsigned int chunks = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	unsigned int sortedChunks = (mSortedCount + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	float radius2 = settings.RepulsionRadius * settings.RepulsionRadius;
+
+	// 1. repulsion only changes velocities, neighbour positions come from the sorted copy.
+	// Walking the particles in cell order makes consecutive queries hit the same cells.
+	mWorkers.Run(sortedChunks, [&](unsigned int chunk) {
+		unsigned int end = std::min(mSortedCount, (chunk + 1) * CHUNK_SIZE);
+		for (unsigned int sorted = chunk * CHUNK_SIZE; sorted < end; sorted++)
+		{
+			unsigned int i = mSortedIndices[sorted];
+			if (particles.type[i] != TYPE_A)
+				continue;
+
+			glm::vec3 position = mSortedPositions[sorted];
+			glm::vec3 push(0.0f);
+			unsigned int neighbours = 0;
+			ForEachNeighbour(position, [&](unsigned int other, glm::vec3 otherPosition) {
+				glm::vec3 offset = position - otherPosition;
+				float distance2 = glm::dot(offset, offset);
+				if (other != i && distance2 < radius2 && distance2 > 0.0f)
+				{
+					float distance = std::sqrt(distance2);
+					push += offset / distance * (1.0f - distance / settings.RepulsionRadius);
+					neighbours++;
+				}
+				return neighbours < settings.MaxNeighbours;
+			});
+
+			push *= settings.RepulsionStrength * deltaTime;
+			particles.velocityX[i] += push.x;
+			particles.velocityY[i] += push.y;
+			particles.velocityZ[i] += push.z;
+		}
+	});
+
+	if (mTerrainCells.empty())
+		return;
+
+	// 2. particles that moved into solid terrain step back and bounce off the surface
+	mWorkers.Run(chunks, [&](unsigned int chunk) {
+		unsigned int end = std::min(count, (chunk + 1) * CHUNK_SIZE);
+		for (unsigned int i = chunk * CHUNK_SIZE; i < end; i++)
+		{
+			if ((alive != nullptr && !alive[i]) || particles.type[i] != TYPE_A)
+				continue;
+
+			glm::vec3 position(particles.positionX[i], particles.positionY[i], particles.positionZ[i]);
+			glm::vec4 terrain = TerrainDensity(position);
+			if (terrain.w <= 0.0f || glm::dot(glm::vec3(terrain), glm::vec3(terrain)) == 0.0f)
+				continue;
+
+			// density grows into the solid, the surface normal points against the gradient
+			glm::vec3 normal = -glm::normalize(glm::vec3(terrain));
+			glm::vec3 velocity(particles.velocityX[i], particles.velocityY[i], particles.velocityZ[i]);
+			position -= velocity * deltaTime;
+			float intoSurface = glm::dot(velocity, normal);
+			if (intoSurface < 0.0f)
+				velocity -= (1.0f + settings.Restitution) * intoSurface * normal;
+
+			particles.positionX[i] = position.x;
+			particles.positionY[i] = position.y;
+			particles.positionZ[i] = position.z;
+			particles.velocityX[i] = velocity.x;
+			particles.velocityY[i] = velocity.y;
+			particles.velocityZ[i] = velocity.z;
+		}
+	});
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include "glm/glm.hpp"
+
+#include "ParticleSimulator.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Settings of the particle to particle and particle to terrain interaction, shared by the CPU and GPU paths
+struct ParticleInteraction
+{
+	bool Enabled = false;
+	float CellSize = 0.5f;
+	// particles closer than this push each other apart
+	float RepulsionRadius = 0.3f;
+	float RepulsionStrength = 20.0f;
+	// neighbours looked at per particle, bounds the cost in dense clusters
+	unsigned int MaxNeighbours = 32;
+	// velocity kept along the normal when bouncing off the terrain
+	float Restitution = 0.3f;
+};
+
+// Hash of an integer cell coordinate, same function as in the grid compute shaders
+inline unsigned int SpatialHashCell(glm::ivec3 cell, unsigned int tableMask)
+{
+	return ((unsigned int)cell.x * 73856093u ^ (unsigned int)cell.y * 19349663u ^ (unsigned int)cell.z * 83492791u) & tableMask;
+}
+
+// Uniform grid over an unbounded space, cells are hashed into a fixed size table.
+// Build is a parallel counting sort: count particles per cell, prefix sum the counts, scatter the particles.
+// The sorted copy of the positions makes neighbour queries read contiguous memory.
+class SpatialHash
+{
+public:
+	static const unsigned int INVALID_CELL = 0xFFFFFFFF;
+
+	// tableSize is rounded up to a power of two
+	SpatialHash(WorkerPool& workers, unsigned int tableSize = 1 << 18);
+
+	// Sorts the particles into cells, dead particles are skipped when an alive mask is given
+	void Build(const ParticleArrays& particles, const unsigned char* alive, unsigned int count, float cellSize);
+
+	glm::ivec3 Cell(glm::vec3 position) const { return glm::ivec3(glm::floor(position / mCellSize)); }
+	unsigned int Hash(glm::ivec3 cell) const { return SpatialHashCell(cell, mTableMask); }
+
+	// Calls visit(index, position) for the particles in the 27 cells around position until it returns false.
+	// Every hash slot is visited once, in cell order and by index inside a slot, so the order is the same in
+	// every run. Other cells sharing a slot are visited as well, callers check the distance.
+	template<typename Visit>
+	void ForEachNeighbour(glm::vec3 position, Visit visit) const;
+
+	// Samples density and gradient of a terrain volume once per cell, in the voxel space of the volume.
+	// Only needs to run again when the terrain changes.
+	void SetTerrain(const float* density, glm::ivec3 dimensions, float cellSize);
+	// Gradient in xyz and density in w of the cell, positive density is solid, outside of the volume is air
+	glm::vec4 TerrainDensity(glm::vec3 position) const;
+
+	// Pushes close particles apart and bounces them off the terrain
+	void Interact(ParticleArrays& particles, const unsigned char* alive, unsigned int count, const ParticleInteraction& settings, float deltaTime);
+
+	unsigned int TableSize() const { return mTableMask + 1; }
+
+private:
+	WorkerPool& mWorkers;
+	unsigned int mTableMask;
+	float mCellSize = 1.0f;
+	unsigned int mSortedCount = 0;
+
+	// tableSize + 1 cell starts, [start[h], start[h + 1]) are the particles of hash slot h after the scan
+	std::unique_ptr<std::atomic<unsigned int>[]> mCellStarts;
+	std::vector<unsigned int> mParticleCells;
+	std::vector<unsigned int> mLocalOffsets;
+	std::vector<unsigned int> mSortedIndices;
+	std::vector<glm::vec3> mSortedPositions;
+
+	std::vector<glm::vec4> mTerrainCells;
+	glm::ivec3 mTerrainDimensions = glm::ivec3(0);
+	float mTerrainCellSize = 1.0f;
+};
+
+template<typename Visit>
+void SpatialHash::ForEachNeighbour(glm::vec3 position, Visit visit) const
+{
+	glm::ivec3 center = Cell(position);
+	// cells of the neighbourhood can share a slot, its particles are only visited once
+	unsigned int visited[27];
+	unsigned int visitedCount = 0;
+	for (int z = -1; z <= 1; z++)
+	{
+		for (int y = -1; y <= 1; y++)
+		{
+			for (int x = -1; x <= 1; x++)
+			{
+				unsigned int hash = Hash(center + glm::ivec3(x, y, z));
+				if (std::find(visited, visited + visitedCount, hash) != visited + visitedCount)
+					continue;
+				visited[visitedCount++] = hash;
+				unsigned int end = mCellStarts[hash + 1].load(std::memory_order_relaxed);
+				for (unsigned int i = mCellStarts[hash].load(std::memory_order_relaxed); i < end; i++)
+				{
+					if (!visit(mSortedIndices[i], mSortedPositions[i]))
+						return;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,67 @@
+#include "TransformFeedbackCounter.h"
+
+TransformFeedbackCounter::TransformFeedbackCounter()
+{
+	glGenQueries(RING_SIZE, mGeneratedQueries);
+	glGenQueries(RING_SIZE, mWrittenQueries);
+	for (unsigned int i = 0; i < RING_SIZE; i++)
+	{
+		mPending[i] = false;
+		mPasses[i] = 0;
+	}
+}
+
+TransformFeedbackCounter::~TransformFeedbackCounter()
+{
+	glDeleteQueries(RING_SIZE, mGeneratedQueries);
+	glDeleteQueries(RING_SIZE, mWrittenQueries);
+}
+
+void TransformFeedbackCounter::Poll()
+{
+	// read every finished pass, oldest first
+	for (unsigned int n = 1; n <= RING_SIZE; n++)
+	{
+		unsigned int i = (mCurrent + n) % RING_SIZE;
+		if (!mPending[i])
+			continue;
+
+		// both queries end together, the second one is available once the first is
+		GLint available = 0;
+		glGetQueryObjectiv(mWrittenQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			continue;
+
+		glGetQueryObjectui64v(mGeneratedQueries[i], GL_QUERY_RESULT, &mGenerated);
+		glGetQueryObjectui64v(mWrittenQueries[i], GL_QUERY_RESULT, &mWritten);
+		mPending[i] = false;
+		mCountedPass = mPasses[i];
+		mTotalOverflow += Overflow();
+		mSamples++;
+	}
+}
+
+void TransformFeedbackCounter::Begin()
+{
+	Poll();
+	mCurrent = (mCurrent + 1) % RING_SIZE;
+	// the ring is full, skip the oldest result instead of waiting for it
+	if (mPending[mCurrent])
+		mPending[mCurrent] = false;
+	mPasses[mCurrent] = ++mPass;
+	glBeginQuery(GL_PRIMITIVES_GENERATED, mGeneratedQueries[mCurrent]);
+	glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, mWrittenQueries[mCurrent]);
+}
+
+void TransformFeedbackCounter::End()
+{
+	glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+	glEndQuery(GL_PRIMITIVES_GENERATED);
+	mPending[mCurrent] = true;
+}
+
+void TransformFeedbackCounter::Reset()
+{
+	mTotalOverflow = 0;
+	mSamples = 0;
+}
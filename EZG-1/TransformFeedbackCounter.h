@@ -0,0 +1,47 @@
+#pragma once
+#include "glad/glad.h"
+
+// Counts the primitives of a transform feedback pass with GL_PRIMITIVES_GENERATED and
+// GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN queries. Like GpuTimer the queries rotate through a ring and results
+// are only read once they are available, so counting never stalls the pipeline. Results lag a few frames behind,
+// Latency tells by how many. Primitives generated but not written did not fit into the feedback buffer.
+class TransformFeedbackCounter
+{
+public:
+	static const unsigned int RING_SIZE = 4;
+
+	TransformFeedbackCounter();
+	~TransformFeedbackCounter();
+
+	// Wrap the glBeginTransformFeedback / glEndTransformFeedback of one pass, one pass per frame
+	void Begin();
+	void End();
+	// Reads every finished result, Begin does so as well
+	void Poll();
+
+	// Primitives written into the feedback buffer by the latest counted pass, the live count for point particles
+	GLuint64 Written() const { return mWritten; }
+	// Primitives the shader emitted in that pass, written or not
+	GLuint64 Generated() const { return mGenerated; }
+	// Primitives dropped in that pass because the feedback buffer was full
+	GLuint64 Overflow() const { return mGenerated - mWritten; }
+	// Passes begun since the one the counts are from
+	unsigned int Latency() const { return mPass - mCountedPass; }
+	// Results read since the last Reset and the primitives dropped over them
+	unsigned int Samples() const { return mSamples; }
+	GLuint64 TotalOverflow() const { return mTotalOverflow; }
+	void Reset();
+
+private:
+	GLuint mGeneratedQueries[RING_SIZE];
+	GLuint mWrittenQueries[RING_SIZE];
+	bool mPending[RING_SIZE];
+	unsigned int mPasses[RING_SIZE];
+	unsigned int mCurrent = 0;
+	unsigned int mPass = 0;
+	unsigned int mCountedPass = 0;
+	GLuint64 mWritten = 0;
+	GLuint64 mGenerated = 0;
+	GLuint64 mTotalOverflow = 0;
+	unsigned int mSamples = 0;
+};
@@ -0,0 +1,319 @@
+#include "VarianceShadowMap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+// Texels a blur work group writes, the same as local_size_x in vsmBlurCS.glsl
+static const int BLUR_TILE_SIZE = 128;
+
+VarianceShadowMap::VarianceShadowMap(int width, int height, int layers, ShadowMode mode, bool fullPrecision)
+	: mWidth(width), mHeight(height), mLayers(layers), mMode(mode), mFullPrecision(fullPrecision)
+{
+	mFilterTimer = new GpuTimer();
+	createTextures();
+	LoadShaders();
+}
+
+VarianceShadowMap::~VarianceShadowMap()
+{
+	deleteTextures();
+	delete mBlurShader;
+	delete mFilterTimer;
+}
+
+GLenum VarianceShadowMap::Format() const
+{
+	if (mMode == SHADOW_EVSM4)
+		return mFullPrecision ? GL_RGBA32F : GL_RGBA16F;
+	return mFullPrecision ? GL_RG32F : GL_RG16F;
+}
+
+size_t VarianceShadowMap::MemoryBytes() const
+{
+	size_t texelBytes = channels() * (mFullPrecision ? 4 : 2);
+	size_t layerTexels = (size_t)mWidth * mHeight;
+	// static cache, moment and blur target, and the depths, 24 bit depths usually take 4 bytes
+	size_t bytes = 3 * layerTexels * mLayers * texelBytes + 2 * layerTexels * mLayers * 4;
+	for (int width = mWidth, height = mHeight; ; width = std::max(width / 2, 1), height = std::max(height / 2, 1))
+	{
+		bytes += (size_t)width * height * mLayers * texelBytes;
+		if (width == 1 && height == 1)
+			break;
+	}
+	return bytes;
+}
+
+float VarianceShadowMap::positiveExponent() const
+{
+	return std::min(std::max(PositiveExponent, 0.0f), mFullPrecision ? SHADOW_MAX_EXPONENT_32F : SHADOW_MAX_EXPONENT_16F);
+}
+
+float VarianceShadowMap::negativeExponent() const
+{
+	return std::min(std::max(NegativeExponent, 0.0f), mFullPrecision ? SHADOW_MAX_EXPONENT_32F : SHADOW_MAX_EXPONENT_16F);
+}
+
+void VarianceShadowMap::farMoments(GLfloat moments[4]) const
+{
+	// a depth of 1, nothing in front of the light. The warps see depths in [-1, 1], see storeDepthPS.glsl
+	if (mMode == SHADOW_VSM)
+	{
+		moments[0] = 1.0f;
+		moments[1] = 1.0f;
+		moments[2] = 0.0f;
+		moments[3] = 0.0f;
+		return;
+	}
+	float positive = std::exp(positiveExponent());
+	float negative = -std::exp(-negativeExponent());
+	moments[0] = positive;
+	moments[1] = positive * positive;
+	moments[2] = mMode == SHADOW_EVSM4 ? negative : 0.0f;
+	moments[3] = mMode == SHADOW_EVSM4 ? negative * negative : 0.0f;
+}
+
+void VarianceShadowMap::SetMode(ShadowMode mode, bool fullPrecision)
+{
+	if (mode == mMode && fullPrecision == mFullPrecision)
+		return;
+	mMode = mode;
+	mFullPrecision = fullPrecision;
+	deleteTextures();
+	createTextures();
+	// the image format of the blur follows the moments
+	LoadShaders();
+	mFilterTimer->Reset();
+}
+
+void VarianceShadowMap::SetUniforms(const Shader& shader) const
+{
+	shader.setInt("shadowMode", mMode);
+	shader.setFloat("positiveExponent", positiveExponent());
+	shader.setFloat("negativeExponent", negativeExponent());
+	shader.setFloat("lightBleedingReduction", std::min(std::max(LightBleedingReduction, 0.0f), 0.99f));
+}
+
+void VarianceShadowMap::createTextures()
+{
+	GLenum format = Format();
+
+	// the moments are rendered in the format they are filtered in, the warped ones do not fit into less
+	for (GLuint* texture : { &mStaticTexture, &mMomentTexture })
+	{
+		glGenTextures(1, texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, *texture);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, format, mWidth, mHeight, mLayers);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	// the depth test keeps the nearest caster, and rejects the hidden ones before their fragment shader runs
+	for (GLuint* texture : { &mStaticDepth, &mMomentDepth })
+	{
+		glGenTextures(1, texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, *texture);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT24, mWidth, mHeight, mLayers);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+
+	// the blur writes through image stores, which need a sized format the images support
+	glGenTextures(1, &mBlurTexture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, mBlurTexture);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, format, mWidth, mHeight, mLayers);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	// the mipmaps of an array shrink every layer on its own
+	int levels = 1 + (int)std::floor(std::log2((float)std::max(mWidth, mHeight)));
+	glGenTextures(1, &mFilteredTexture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, mFilteredTexture);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, format, mWidth, mHeight, mLayers);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	glGenFramebuffers(1, &mFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, mMomentTexture, 0, 0);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mMomentDepth, 0, 0);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	glReadBuffer(GL_NONE);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "ERROR::SHADOW_MAP::FRAMEBUFFER_INCOMPLETE" << std::endl;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// nothing is cached in the new textures
+	mStaticMatrices.assign(mLayers, glm::mat4(1.0f));
+	mStaticValid.assign(mLayers, false);
+	mDynamicLastFrame = false;
+	mFilterDirty = true;
+}
+
+void VarianceShadowMap::deleteTextures()
+{
+	glDeleteFramebuffers(1, &mFramebuffer);
+	glDeleteTextures(1, &mStaticTexture);
+	glDeleteTextures(1, &mStaticDepth);
+	glDeleteTextures(1, &mMomentTexture);
+	glDeleteTextures(1, &mMomentDepth);
+	glDeleteTextures(1, &mBlurTexture);
+	glDeleteTextures(1, &mFilteredTexture);
+	mFramebuffer = mStaticTexture = mStaticDepth = mMomentTexture = mMomentDepth = mBlurTexture = mFilteredTexture = 0;
+}
+
+void VarianceShadowMap::LoadShaders()
+{
+	const char* format = "rg16f";
+	switch (Format())
+	{
+	case GL_RG32F: format = "rg32f"; break;
+	case GL_RGBA16F: format = "rgba16f"; break;
+	case GL_RGBA32F: format = "rgba32f"; break;
+	}
+	delete mBlurShader;
+	mBlurShader = new Shader("Shaders/vsmBlurCS.glsl", std::string("#define MOMENT_FORMAT ") + format + "\n");
+	mWeightRadius = -1;
+	// storeDepthPS.glsl may have been reloaded with it
+	InvalidateStatic();
+}
+
+void VarianceShadowMap::InvalidateStatic()
+{
+	mStaticValid.assign(mLayers, false);
+}
+
+void VarianceShadowMap::ResetStats()
+{
+	mFilterTimer->Reset();
+	mFrames = 0;
+	mStaticRenders = 0;
+	mFilters = 0;
+}
+
+void VarianceShadowMap::Resize(int width, int height)
+{
+	if (width == mWidth && height == mHeight)
+		return;
+	mWidth = width;
+	mHeight = height;
+	deleteTextures();
+	createTextures();
+	mFilterTimer->Reset();
+}
+
+void VarianceShadowMap::bindLayer(GLuint texture, GLuint depth, int layer)
+{
+	glViewport(0, 0, mWidth, mHeight);
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0, layer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0, layer);
+}
+
+bool VarianceShadowMap::BeginStaticPass(int layer, const glm::mat4& lightSpaceMatrix)
+{
+	// the warps of the cached moments change with the exponents
+	if (positiveExponent() != mStaticPositiveExponent || negativeExponent() != mStaticNegativeExponent)
+	{
+		InvalidateStatic();
+		mStaticPositiveExponent = positiveExponent();
+		mStaticNegativeExponent = negativeExponent();
+	}
+	if (mStaticValid[layer] && mStaticMatrices[layer] == lightSpaceMatrix)
+		return false;
+
+	mStaticValid[layer] = true;
+	mStaticMatrices[layer] = lightSpaceMatrix;
+	mFilterDirty = true;
+	mStaticRenders++;
+
+	bindLayer(mStaticTexture, mStaticDepth, layer);
+	GLfloat moments[4];
+	farMoments(moments);
+	glClearBufferfv(GL_COLOR, 0, moments);
+	GLfloat farDepth = 1.0f;
+	glClearBufferfv(GL_DEPTH, 0, &farDepth);
+	return true;
+}
+
+void VarianceShadowMap::BeginDynamicPass(int layer)
+{
+	glCopyImageSubData(mStaticTexture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, mMomentTexture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, mWidth, mHeight, 1);
+	glCopyImageSubData(mStaticDepth, GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, mMomentDepth, GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, mWidth, mHeight, 1);
+	bindLayer(mMomentTexture, mMomentDepth, layer);
+	mDynamicFrame = true;
+}
+
+void VarianceShadowMap::setWeights()
+{
+	// sigma of half the radius, the tails beyond the radius are cut off and the rest normalized
+	float weights[MAX_BLUR_RADIUS + 1];
+	float sigma = std::max(BlurRadius * 0.5f, 0.5f);
+	float total = 0.0f;
+	for (int i = 0; i <= BlurRadius; i++)
+	{
+		weights[i] = std::exp(-0.5f * i * i / (sigma * sigma));
+		total += i == 0 ? weights[i] : 2.0f * weights[i];
+	}
+	for (int i = 0; i <= BlurRadius; i++)
+		mBlurShader->setFloat("weights[" + std::to_string(i) + "]", weights[i] / total);
+	mBlurShader->setInt("radius", BlurRadius);
+	mWeightRadius = BlurRadius;
+}
+
+void VarianceShadowMap::blur(GLuint source, GLuint destination, bool horizontal)
+{
+	mBlurShader->setBool("horizontal", horizontal);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, source);
+	glBindImageTexture(0, destination, 0, GL_TRUE, 0, GL_WRITE_ONLY, Format());
+
+	// one work group per tile of a row, or of a column for the vertical pass, of every layer
+	int length = horizontal ? mWidth : mHeight;
+	int rows = horizontal ? mHeight : mWidth;
+	glDispatchCompute((length + BLUR_TILE_SIZE - 1) / BLUR_TILE_SIZE, rows, mLayers);
+	// read by the next pass, the mipmap generation and the lighting pass
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+void VarianceShadowMap::EndShadowPass()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	BlurRadius = std::min(std::max(BlurRadius, 0), MAX_BLUR_RADIUS);
+	mFrames++;
+
+	// the filtered moments of the last frame are still right, a static scene ends here
+	bool dynamic = mDynamicFrame;
+	bool changed = mFilterDirty || dynamic || mDynamicLastFrame || mFilteredRadius != BlurRadius;
+	mDynamicLastFrame = dynamic;
+	mDynamicFrame = false;
+	if (!changed)
+		return;
+	mFilterDirty = false;
+	mFilteredRadius = BlurRadius;
+	mFilters++;
+
+	mFilterTimer->Begin();
+	mBlurShader->use();
+	if (mWeightRadius != BlurRadius)
+		setWeights();
+	// a radius of 0 still copies the moments into the filtered texture
+	blur(dynamic ? mMomentTexture : mStaticTexture, mBlurTexture, true);
+	blur(mBlurTexture, mFilteredTexture, false);
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, mFilteredTexture);
+	GLfloat maxAnisotropy = 1.0f;
+	glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &maxAnisotropy);
+	glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY, std::min(std::max(Anisotropy, 1.0f), maxAnisotropy));
+	// outside the map everything is lit, the exponents may have changed since the last frame
+	GLfloat borderColor[4];
+	farMoments(borderColor);
+	glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	mFilterTimer->End();
+}
@@ -0,0 +1,147 @@
+#pragma once
+#include "glad/glad.h"
+
+#include "Shader.h"
+#include "GpuTimer.h"
+
+#include <vector>
+
+// What the shadow map stores and how the lighting pass turns it into a shadow
+enum ShadowMode {
+	// depth and depth squared, cheap but leaks light where occluders overlap
+	SHADOW_VSM,
+	// moments of exp(c * depth), the exponential warp hides most of the leaking
+	SHADOW_EVSM2,
+	// positive and negative exponential warp, the smaller of both upper bounds
+	SHADOW_EVSM4,
+	SHADOW_MODE_COUNT
+};
+
+const char* const shadowModeNames[] = { "VSM", "EVSM 2 moments", "EVSM 4 moments" };
+
+// Largest EVSM exponents whose squared warps still fit into half and full floats
+const float SHADOW_MAX_EXPONENT_16F = 5.54f;
+const float SHADOW_MAX_EXPONENT_32F = 42.0f;
+
+// Moments of the light's depth for variance shadow mapping, one layer of a texture array per shadow cascade.
+// The shadow pass renders raw moments into a render target, EndShadowPass then blurs them with a separable
+// Gaussian in two compute passes and builds mipmaps, so the lighting pass can sample them trilinear and
+// anisotropic. Pre-filtering is what VSM is for: the blurred moments give soft, alias free shadow edges for
+// one texture fetch.
+// The exponential modes store moments of warped depths instead, which need 32 bit floats for large exponents.
+// SetUniforms hands the mode to storeDepthPS.glsl, which writes the moments, and varianceShadowMapPS.glsl.
+// The moments are depth tested against a depth attachment, only the nearest caster of a texel is written.
+// Static casters are rendered into a cache that is only redrawn when a layer's light space matrix changes or
+// InvalidateStatic is called. The matrices of ShadowCascades are snapped to texels, they change whenever the
+// camera moved a texel of the cascade. Dynamic casters are depth tested against a copy of it every frame.
+// Without dynamic casters and changes nothing is rendered or filtered at all.
+class VarianceShadowMap
+{
+public:
+	// Largest blur radius in texels, bounds the shared memory tile of vsmBlurCS.glsl
+	static const int MAX_BLUR_RADIUS = 32;
+
+	VarianceShadowMap(int width, int height, int layers = 1, ShadowMode mode = SHADOW_VSM, bool fullPrecision = false);
+	~VarianceShadowMap();
+
+	// Gaussian blur radius in texels, 0 only builds the mipmaps
+	int BlurRadius = 4;
+	// Anisotropic filtering of the filtered moments, clamped to what the driver supports
+	float Anisotropy = 8.0f;
+	// Exponents of the warps of the EVSM modes, clamped to what the moment format holds
+	float PositiveExponent = 40.0f;
+	float NegativeExponent = 5.0f;
+	// Upper bounds below this count as fully shadowed and the rest is rescaled, cuts off the light that
+	// leaks through overlapping occluders at the price of smaller penumbrae. 0 turns it off
+	float LightBleedingReduction = 0.2f;
+
+	// Reallocates the moments in the format of mode, RG or RGBA in 16 or 32 bit floats
+	void SetMode(ShadowMode mode, bool fullPrecision);
+	ShadowMode Mode() const { return mMode; }
+	bool FullPrecision() const { return mFullPrecision; }
+	// Sets shadowMode, the exponents and lightBleedingReduction of shader, which has to be in use
+	void SetUniforms(const Shader& shader) const;
+
+	// (Re)loads the blur shader, called on shader hot reloading, and redraws the static casters
+	void LoadShaders();
+
+	// Reallocates every layer with width x height texels and redraws the static casters
+	void Resize(int width, int height);
+
+	// Binds layer of the static cache and its viewport, cleared to the far plane. Returns false
+	// without binding anything if the layer is cached for lightSpaceMatrix, the static casters are skipped then
+	bool BeginStaticPass(int layer, const glm::mat4& lightSpaceMatrix);
+	// Binds layer of the moment render target over a copy of its static casters and their depth. Once called
+	// in a frame it has to be called for every layer
+	void BeginDynamicPass(int layer);
+	// Unbinds the render target and filters the moments of every layer, unless nothing changed since the last time
+	void EndShadowPass();
+	// Redraws the static casters of every layer in the next frame, when the light or a static object moved
+	void InvalidateStatic();
+
+	// Filtered moments with mipmaps, a 2D texture array the lighting pass samples
+	GLuint Texture() const { return mFilteredTexture; }
+	int Width() const { return mWidth; }
+	int Height() const { return mHeight; }
+	int Layers() const { return mLayers; }
+	GLenum Format() const;
+	// Static cache, moment render target and their depths, blur target and the filtered moments with their mipmaps
+	size_t MemoryBytes() const;
+	// GPU time of the blur and the mipmaps, averaged over the filtered frames since the last ResetStats
+	double FilterMilliseconds() const { return mFilterTimer->AverageMilliseconds(); }
+	// Shadow passes, static layers redrawn and shadow passes filtered since the last ResetStats
+	int Frames() const { return mFrames; }
+	int StaticRenders() const { return mStaticRenders; }
+	int Filters() const { return mFilters; }
+	void ResetStats();
+
+private:
+	int mWidth;
+	int mHeight;
+	int mLayers;
+	ShadowMode mMode;
+	bool mFullPrecision;
+	GLuint mFramebuffer = 0;
+	// moments and depth of the static casters
+	GLuint mStaticTexture = 0;
+	GLuint mStaticDepth = 0;
+	// static and dynamic casters
+	GLuint mMomentTexture = 0;
+	GLuint mMomentDepth = 0;
+	// result of the horizontal pass
+	GLuint mBlurTexture = 0;
+	GLuint mFilteredTexture = 0;
+	// radius the weights uniform was last computed for
+	int mWeightRadius = -1;
+
+	// light space matrix every static layer was drawn with, and whether it is still valid
+	std::vector<glm::mat4> mStaticMatrices;
+	std::vector<bool> mStaticValid;
+	// exponents the static moments are warped with
+	float mStaticPositiveExponent = 0.0f;
+	float mStaticNegativeExponent = 0.0f;
+	// dynamic casters this and last frame, the filtered moments still hold them in the frame after
+	bool mDynamicFrame = false;
+	bool mDynamicLastFrame = false;
+	// a static layer was redrawn since the last filtering
+	bool mFilterDirty = true;
+	// blur radius of the filtered moments
+	int mFilteredRadius = -1;
+	int mFrames = 0;
+	int mStaticRenders = 0;
+	int mFilters = 0;
+
+	Shader* mBlurShader = nullptr;
+	GpuTimer* mFilterTimer = nullptr;
+
+	void createTextures();
+	void deleteTextures();
+	int channels() const { return mMode == SHADOW_EVSM4 ? 4 : 2; }
+	float positiveExponent() const;
+	float negativeExponent() const;
+	// moments of the far plane, the clear and border color
+	void farMoments(GLfloat moments[4]) const;
+	void bindLayer(GLuint texture, GLuint depth, int layer);
+	void blur(GLuint source, GLuint destination, bool horizontal);
+	void setWeights();
+};
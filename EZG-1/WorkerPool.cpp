@@ -0,0 +1,98 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(unsigned int threadCount) : mNextTask(0)
+{
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	// the calling thread is the first worker
+	for (unsigned int i = 1; i < threadCount; i++)
+		mWorkers.emplace_back(&WorkerPool::workerLoop, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWakeUp.notify_all();
+	for (std::thread& worker : mWorkers)
+		worker.join();
+}
+
+unsigned int WorkerPool::ThreadCount() const
+{
+	return (unsigned int)mWorkers.size() + 1;
+}
+
+void WorkerPool::work(const std::function<void(unsigned int)>& task, unsigned int taskCount)
+{
+	unsigned int next;
+	while ((next = mNextTask.fetch_add(1)) < taskCount)
+		task(next);
+}
+
+void WorkerPool::workerLoop()
+{
+	unsigned int generation = 0;
+	while (true)
+	{
+		const std::function<void(unsigned int)>* task;
+		unsigned int taskCount;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWakeUp.wait(lock, [&] { return mQuit || mGeneration != generation; });
+			if (mQuit)
+				return;
+			generation = mGeneration;
+			// woke up after that Run already returned, touching mNextTask now would steal a task of the next one
+			if (!mTask)
+				continue;
+			task = mTask;
+			taskCount = mTaskCount;
+			mBusyWorkers++;
+		}
+
+		work(*task, taskCount);
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mBusyWorkers--;
+		}
+		mDone.notify_one();
+	}
+}
+
+void WorkerPool::Run(unsigned int taskCount, const std::function<void(unsigned int task)>& task)
+{
+	if (taskCount == 0)
+		return;
+
+	// not worth waking anyone up for a single task
+	if (taskCount == 1 || mWorkers.empty())
+	{
+		for (unsigned int i = 0; i < taskCount; i++)
+			task(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTask = &task;
+		mTaskCount = taskCount;
+		mNextTask = 0;
+		mGeneration++;
+	}
+	mWakeUp.notify_all();
+
+	work(task, taskCount);
+
+	// wait until every worker that picked up this generation has finished its last task
+	std::unique_lock<std::mutex> lock(mMutex);
+	mDone.wait(lock, [&] { return mBusyWorkers == 0 && mNextTask >= mTaskCount; });
+	mTask = nullptr;
+	mTaskCount = 0;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small pool of persistent worker threads for splitting CPU work into tasks.
+// Run blocks until all tasks are done, the calling thread works on tasks as well.
+class WorkerPool
+{
+public:
+	// threadCount 0 uses one thread per hardware thread
+	WorkerPool(unsigned int threadCount = 0);
+	~WorkerPool();
+
+	void Run(unsigned int taskCount, const std::function<void(unsigned int task)>& task);
+
+	// Number of threads working on tasks, including the calling thread
+	unsigned int ThreadCount() const;
+
+private:
+	std::vector<std::thread> mWorkers;
+	std::mutex mMutex;
+	std::condition_variable mWakeUp;
+	std::condition_variable mDone;
+
+	const std::function<void(unsigned int)>* mTask = nullptr;
+	unsigned int mTaskCount = 0;
+	std::atomic<unsigned int> mNextTask;
+	unsigned int mBusyWorkers = 0;
+	unsigned int mGeneration = 0;
+	bool mQuit = false;
+
+	void workerLoop();
+	// task and taskCount are the ones of the current Run, read under the lock
+	void work(const std::function<void(unsigned int)>& task, unsigned int taskCount);
+};